@@ -0,0 +1,72 @@
+#include "aot.h"
+
+CHIP8 *aot_machine;
+
+static uint8_t is_code(uint16_t addr) {
+  return (aot_code[addr >> 3] >> (addr & 7)) & 1;
+}
+
+/**
+ * Translated byte at `addr` no longer holds what the translation was made of
+ */
+static uint8_t code_changed(CHIP8 *chip8, uint16_t addr) {
+  return is_code(addr) && MEM_READ(chip8, addr) != aot_rom[addr - MEM_START];
+}
+
+/**
+ * @brief run the translation for `chip8` if its memory holds the translated
+ * code and it runs with the same quirks, called after a ROM is loaded
+ * @param  *chip8: instance with a ROM loaded
+ * @retval None
+ */
+void aot_attach(CHIP8 *chip8) {
+  uint8_t matches = chip8->image->quirks == aot_quirks;
+  for (uint32_t addr = 0; matches && addr < MEM_SIZE; addr++) {
+    matches = !code_changed(chip8, addr);
+  }
+  if (matches) {
+    aot_machine = chip8;
+  } else if (aot_machine == chip8) {
+    aot_machine = NULL;
+  }
+}
+
+/**
+ * @brief drop the translation when a write changed translated code, called
+ * by chip8_invalidate()
+ * @param  *chip8: instance written to
+ * @param  addr: first byte written
+ * @param  len: number of bytes written
+ * @retval None
+ */
+void aot_invalidate(CHIP8 *chip8, uint16_t addr, uint32_t len) {
+  if (chip8 != aot_machine) {
+    return;
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    if (code_changed(chip8, (addr + i) & (MEM_SIZE - 1))) {
+      aot_machine = NULL;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief execute up to `cycles` instructions, translated blocks where
+ * possible and the interpreter in between
+ * @param  *chip8: the attached instance
+ * @param  cycles: number of instructions to execute
+ * @retval instructions left to run when the translation was dropped
+ */
+uint32_t aot_run(CHIP8 *chip8, uint32_t cycles) {
+  while (cycles && chip8 == aot_machine) {
+    uint32_t done = aot_blocks(chip8, cycles);
+    if (done) {
+      cycles -= done;
+    } else {
+      chip8_cycle(chip8);
+      cycles--;
+    }
+  }
+  return cycles;
+}
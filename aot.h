@@ -0,0 +1,42 @@
+#ifndef __AOT_H__
+#define __AOT_H__
+
+#include "chip8.h"
+
+/**
+ * Ahead-of-time translated ROM, built in with -DCHIP8_AOT.
+ *
+ * chip8-aot (translator.c) traces a ROM's control flow from MEM_START through
+ * jumps, calls and skips and writes every basic block it finds as C: straight
+ * calls of the opcode handlers with constant operands, which the compiler
+ * inlines. The generated file defines the data and aot_blocks() below, aot.c
+ * holds the glue chip8_run() goes through.
+ *
+ * Whatever the translation doesn't cover runs in the interpreter: BNNN
+ * targets, code outside the ROM and the tail of a burst too short for a whole
+ * block. The translation is dropped for good once a write changes a
+ * translated instruction. It serves one instance at a time, and only one
+ * running with the quirks it was translated for.
+ */
+
+// generated by chip8-aot
+extern const char aot_rom_name[];
+extern const uint8_t aot_rom[];
+extern const uint32_t aot_rom_size;
+// QUIRK_* flags the handlers were picked for
+extern const uint32_t aot_quirks;
+// one bit per byte of translated code, bit a & 7 of byte a >> 3
+extern const uint8_t aot_code[MEM_SIZE / 8];
+
+uint32_t aot_blocks(CHIP8 *chip8, uint32_t cycles);
+
+// instance the translation runs for, NULL when none
+extern CHIP8 *aot_machine;
+
+void aot_attach(CHIP8 *chip8);
+
+void aot_invalidate(CHIP8 *chip8, uint16_t addr, uint32_t len);
+
+uint32_t aot_run(CHIP8 *chip8, uint32_t cycles);
+
+#endif  //__AOT_H__
@@ -0,0 +1,97 @@
+#include "audio.h"
+
+#include <math.h>
+
+// amplitude of the 1-bit output
+#define AUDIO_VOLUME 4000
+#define PHASE_FRACTION_BITS 25
+
+#if CHIP8_VARIANT != CHIP8_XO
+// 500 Hz square wave at the fixed pitch
+static const uint8_t BEEP_PATTERN[16] = {
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+};
+#endif
+
+/**
+ * @brief samples queued and not yet played
+ * @param  *ring: sample ring
+ * @retval sample count
+ */
+uint32_t audio_ring_count(AUDIO_RING *ring) {
+  return atomic_load_explicit(&ring->head, memory_order_acquire) -
+         atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/**
+ * @brief append up to n samples, called by the producer only
+ * @param  *ring: sample ring
+ * @param  *samples: samples to append
+ * @param  n: number of samples
+ * @retval samples appended, fewer than n when the ring is full
+ */
+uint32_t audio_ring_push(AUDIO_RING *ring, const int16_t *samples,
+                         uint32_t n) {
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint32_t space = AUDIO_RING_SIZE - (head - tail);
+  n = n < space ? n : space;
+  for (uint32_t i = 0; i < n; i++) {
+    ring->samples[(head + i) & (AUDIO_RING_SIZE - 1)] = samples[i];
+  }
+  // publish the samples before the new head
+  atomic_store_explicit(&ring->head, head + n, memory_order_release);
+  return n;
+}
+
+/**
+ * @brief take up to n samples, called by the consumer only
+ * @param  *ring: sample ring
+ * @param  *samples: output
+ * @param  n: samples wanted
+ * @retval samples taken, fewer than n when the ring runs dry
+ */
+uint32_t audio_ring_pop(AUDIO_RING *ring, int16_t *samples, uint32_t n) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint32_t count = head - tail;
+  n = n < count ? n : count;
+  for (uint32_t i = 0; i < n; i++) {
+    samples[i] = ring->samples[(tail + i) & (AUDIO_RING_SIZE - 1)];
+  }
+  // hand the slots back only after they were read
+  atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+  return n;
+}
+
+/**
+ * @brief render a block of samples of the current audio pattern, the phase
+ * carries over between blocks so the wave has no seams
+ * @note  classic and SUPER-CHIP play a fixed square wave, XO-CHIP plays the
+ * F002 pattern at the FX3A pitch
+ * @param  *voice: generator state
+ * @param  *chip8: machine whose pattern and pitch are played
+ * @param  *samples: output
+ * @param  n: number of samples
+ * @retval None
+ */
+void audio_render(AUDIO_VOICE *voice, const CHIP8 *chip8, int16_t *samples,
+                  uint32_t n) {
+#if CHIP8_VARIANT == CHIP8_XO
+  const uint8_t *pattern = chip8->pattern;
+  double rate = AUDIO_PATTERN_RATE * exp2((chip8->pitch - 64) / 48.0);
+#else
+  const uint8_t *pattern = BEEP_PATTERN;
+  double rate = AUDIO_PATTERN_RATE;
+#endif
+  uint32_t step =
+      (uint32_t)(rate / AUDIO_RATE * (1u << PHASE_FRACTION_BITS) + 0.5);
+  uint32_t phase = voice->phase;
+  for (uint32_t i = 0; i < n; i++, phase += step) {
+    uint32_t bit = phase >> PHASE_FRACTION_BITS;
+    samples[i] = (pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? AUDIO_VOLUME
+                                                            : -AUDIO_VOLUME;
+  }
+  voice->phase = phase;
+}
@@ -0,0 +1,46 @@
+#ifndef __AUDIO_H__
+#define __AUDIO_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// output sample rate in Hz
+#define AUDIO_RATE 48000
+// samples generated per 60 Hz frame
+#define AUDIO_FRAME_SAMPLES (AUDIO_RATE / 60)
+// ring capacity in samples, a power of two
+#define AUDIO_RING_SIZE 4096
+// audio pattern bits played per second at pitch 64
+#define AUDIO_PATTERN_RATE 4000
+
+/**
+ * Single-producer/single-consumer sample ring. The emulation thread pushes,
+ * the audio callback pops, neither ever blocks or takes a lock. The indices
+ * run freely and are masked on access; each lives on its own cache line so
+ * the two threads don't fight over one.
+ */
+typedef struct audio_ring {
+  _Alignas(64) atomic_uint head;  // next sample written, producer owned
+  _Alignas(64) atomic_uint tail;  // next sample read, consumer owned
+  _Alignas(64) int16_t samples[AUDIO_RING_SIZE];
+} AUDIO_RING;
+
+/**
+ * Sample generator, plays the 128-bit audio pattern as 1-bit samples
+ */
+typedef struct audio_voice {
+  uint32_t phase;  // position in the pattern, 7.25 fixed point bits
+} AUDIO_VOICE;
+
+uint32_t audio_ring_count(AUDIO_RING *ring);
+
+uint32_t audio_ring_push(AUDIO_RING *ring, const int16_t *samples, uint32_t n);
+
+uint32_t audio_ring_pop(AUDIO_RING *ring, int16_t *samples, uint32_t n);
+
+void audio_render(AUDIO_VOICE *voice, const CHIP8 *chip8, int16_t *samples,
+                  uint32_t n);
+
+#endif  //__AUDIO_H__
@@ -0,0 +1,165 @@
+/**
+ * Benchmarks, one JSON object per line:
+ *  - micro: every opcode_* handler called directly on a predecoded
+ *    instruction, and the chip8_cycle()/chip8_run() dispatch loops
+ *  - macro: every ROM given on the command line run headless for a fixed
+ *    number of cycles with each backend
+ */
+#include "chip8.h"
+#include "headless.h"
+
+#define MICRO_ITERATIONS 2000000
+#define MACRO_CYCLES 20000000
+
+typedef struct bench_op {
+  const char *name;
+  uint16_t opcode;
+  opcode_func func;
+} BENCH_OP;
+
+static const BENCH_OP OPS[] = {
+    {"00E0", 0x00E0, opcode_00E0}, {"1NNN", 0x1300, opcode_1NNN},
+    {"3XNN", 0x3142, opcode_3XNN}, {"4XNN", 0x4142, opcode_4XNN},
+    {"5XY0", 0x5120, opcode_5XY0}, {"6XNN", 0x6142, opcode_6XNN},
+    {"7XNN", 0x7142, opcode_7XNN}, {"8XY0", 0x8120, opcode_8XY0},
+    {"8XY1", 0x8121, opcode_8XY1}, {"8XY2", 0x8122, opcode_8XY2},
+    {"8XY3", 0x8123, opcode_8XY3}, {"8XY4", 0x8124, opcode_8XY4},
+    {"8XY5", 0x8125, opcode_8XY5}, {"8XY6", 0x8126, opcode_8XY6},
+    {"8XY7", 0x8127, opcode_8XY7}, {"8XYE", 0x812E, opcode_8XYE},
+    {"9XY0", 0x9120, opcode_9XY0}, {"ANNN", 0xA300, opcode_ANNN},
+    {"BNNN", 0xB300, opcode_BNNN}, {"CXNN", 0xC1FF, opcode_CXNN},
+    {"DXYN", 0xD125, opcode_DXYN}, {"EX9E", 0xE19E, opcode_EX9E},
+    {"EXA1", 0xE1A1, opcode_EXA1}, {"FX07", 0xF107, opcode_FX07},
+    {"FX0A", 0xF10A, opcode_FX0A}, {"FX15", 0xF115, opcode_FX15},
+    {"FX18", 0xF118, opcode_FX18}, {"FX1E", 0xF11E, opcode_FX1E},
+    {"FX29", 0xF129, opcode_FX29}, {"FX33", 0xF133, opcode_FX33},
+    {"FX55", 0xF555, opcode_FX55}, {"FX65", 0xF565, opcode_FX65},
+    // quirk variants
+    {"8XY1_VF", 0x8121, opcode_8XY1_VF}, {"8XY6_VY", 0x8126, opcode_8XY6_VY},
+    {"8XYE_VY", 0x812E, opcode_8XYE_VY}, {"BXNN", 0xB300, opcode_BXNN},
+    {"DXYN_WRAP", 0xD125, opcode_DXYN_WRAP},
+    {"FX55_I", 0xF555, opcode_FX55_I}, {"FX65_I", 0xF565, opcode_FX65_I},
+};
+
+static void report(const char *kind, const char *name, const char *backend,
+                   uint64_t instructions, uint64_t frames, double seconds) {
+  printf(
+      "{\"kind\":\"%s\",\"name\":\"%s\",\"backend\":\"%s\","
+      "\"instructions\":%llu,\"seconds\":%.6f,\"ips\":%.0f,"
+      "\"ns_per_inst\":%.3f,\"fps\":%.1f}\n",
+      kind, name, backend, (unsigned long long)instructions, seconds,
+      seconds > 0 ? instructions / seconds : 0,
+      instructions ? seconds * 1e9 / instructions : 0,
+      seconds > 0 ? frames / seconds : 0);
+}
+
+static CHIP8 *bench_instance() {
+  CHIP8 *chip8 = chip8_init();
+  chip8_seed(chip8, 1);
+  chip8->reg[1] = 10;
+  chip8->reg[2] = 20;
+  chip8->index_reg = 0x300;
+  chip8->keys[10] = 1;
+  return chip8;
+}
+
+/**
+ * Call one handler in a loop, the state it leaves behind is reset often
+ * enough that every call does the same amount of work
+ */
+static void micro_op(const BENCH_OP *op) {
+  CHIP8 *chip8 = bench_instance();
+  CHIP8_INST inst;
+  chip8_decode(op->opcode, 0, &inst);
+  double start = headless_seconds();
+  for (int i = 0; i < MICRO_ITERATIONS; i++) {
+    op->func(chip8, &inst);
+    chip8->pc = MEM_START;
+    chip8->reg[1] = 10;
+    chip8->index_reg = 0x300;
+  }
+  double seconds = headless_seconds() - start;
+  report("micro", op->name, "handler", MICRO_ITERATIONS, 0, seconds);
+  chip8_free(chip8);
+}
+
+/**
+ * A call and its return measured together, neither can run on its own
+ */
+static void micro_call() {
+  CHIP8 *chip8 = bench_instance();
+  CHIP8_INST call, ret;
+  chip8_decode(0x2300, 0, &call);
+  chip8_decode(0x00EE, 0, &ret);
+  double start = headless_seconds();
+  for (int i = 0; i < MICRO_ITERATIONS; i++) {
+    opcode_2NNN(chip8, &call);
+    opcode_00EE(chip8, &ret);
+  }
+  double seconds = headless_seconds() - start;
+  report("micro", "2NNN+00EE", "handler", 2 * MICRO_ITERATIONS, 0, seconds);
+  chip8_free(chip8);
+}
+
+/**
+ * Fetch and dispatch cost: a loop of register moves closed by a jump, run
+ * one chip8_cycle() at a time and in chip8_run() bursts
+ */
+static void micro_dispatch() {
+  uint8_t rom[256];
+  for (int i = 0; i < (int)sizeof(rom) - 2; i += 2) {
+    rom[i] = 0x81;
+    rom[i + 1] = 0x20;
+  }
+  rom[sizeof(rom) - 2] = 0x12;
+  rom[sizeof(rom) - 1] = 0x00;
+  const uint64_t cycles = 10 * MICRO_ITERATIONS;
+
+  CHIP8 *chip8 = bench_instance();
+  chip8_load_bytes(chip8, rom, sizeof(rom));
+  double start = headless_seconds();
+  for (uint64_t i = 0; i < cycles; i++) {
+    chip8_cycle(chip8);
+  }
+  report("micro", "dispatch", "chip8_cycle", cycles, 0,
+         headless_seconds() - start);
+  chip8_free(chip8);
+
+  chip8 = bench_instance();
+  chip8_load_bytes(chip8, rom, sizeof(rom));
+  start = headless_seconds();
+  for (uint64_t i = 0; i < cycles; i += 1000) {
+    chip8_run(chip8, 1000);
+  }
+  report("micro", "dispatch", "chip8_run", cycles, 0,
+         headless_seconds() - start);
+  chip8_free(chip8);
+}
+
+static void macro_rom(const char *rom_name, enum backend backend) {
+  CHIP8 *chip8 = chip8_init();
+  chip8_seed(chip8, 1);
+  if (!chip8_load_rom(chip8, rom_name)) {
+    chip8_free(chip8);
+    return;
+  }
+  HEADLESS_STATS stats;
+  chip8_run_headless(chip8, MACRO_CYCLES, 0, CYCLE_FREQUENCY, backend, NULL,
+                     &stats);
+  report("macro", rom_name, backend == BACKEND_JIT ? "jit" : "interp",
+         stats.cycles, stats.frames, stats.seconds);
+  chip8_free(chip8);
+}
+
+int main(int argc, char const *argv[]) {
+  for (size_t i = 0; i < sizeof(OPS) / sizeof(OPS[0]); i++) {
+    micro_op(&OPS[i]);
+  }
+  micro_call();
+  micro_dispatch();
+  for (int i = 1; i < argc; i++) {
+    macro_rom(argv[i], BACKEND_INTERP);
+    macro_rom(argv[i], BACKEND_JIT);
+  }
+  return 0;
+}
@@ -0,0 +1,301 @@
+#include "capture.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// framebuffer pixels expanded by one table lookup
+#define NIBBLE 4
+
+typedef struct capture_frame {
+  DISPLAY_ROW display[DISPLAY_PLANES * DISPLAY_HEIGHT];
+} CAPTURE_FRAME;
+
+struct capture {
+  FILE *out;
+  enum capture_format format;
+  int scale;
+  int width;          // output size in pixels
+  int height;
+  int pixel_bytes;    // 1 for the Y4M luma plane, 4 for RGBA
+  size_t row_bytes;   // one output row
+  size_t plane_size;  // the scaled image, luma plane or RGBA
+  uint8_t *image;     // scaled image, plus room for the last 16-byte store
+  uint8_t *chroma;    // constant Y4M chroma planes
+  // NIBBLE scaled pixels for every combination of NIBBLE pixel values, one
+  // entry per plane-0 nibble | plane-1 nibble << 4, padded to 16 bytes
+  uint8_t *table;
+  size_t entry_bytes;
+  size_t entry_stride;
+
+  // single producer (capture_frame) / single consumer (writer thread) queue
+  CAPTURE_FRAME frames[CAPTURE_QUEUE];
+  _Alignas(64) atomic_uint head;
+  _Alignas(64) atomic_uint tail;
+  atomic_bool closing;
+  pthread_mutex_t lock;  // only guards the sleeps of the two threads
+  pthread_cond_t ready;  // a frame was queued
+  pthread_cond_t room;   // a frame was written, offline captures only
+  pthread_t thread;
+  uint8_t threaded;  // 0 if the writer thread couldn't start
+  uint8_t realtime;  // drop frames rather than wait for the writer
+  uint64_t dropped;  // producer only
+};
+
+/**
+ * @brief pick the format from the file name: `.rgba` and `.raw` are raw RGBA,
+ * everything else, stdout included, is Y4M
+ * @param  *file_name: output file, `-` for stdout
+ * @retval capture format
+ */
+enum capture_format capture_format_of(const char *file_name) {
+  const char *dot = strrchr(file_name, '.');
+  if (dot && (strcmp(dot, ".rgba") == 0 || strcmp(dot, ".raw") == 0)) {
+    return CAPTURE_RGBA;
+  }
+  return CAPTURE_Y4M;
+}
+
+/**
+ * BT.601 studio-swing luma of an RGBA color
+ */
+static uint8_t luma(uint32_t rgba) {
+  uint32_t r = rgba >> 24, g = (rgba >> 16) & 0xFF, b = (rgba >> 8) & 0xFF;
+  return 16 + ((16829 * r + 33039 * g + 6416 * b + 32768) >> 16);
+}
+
+static void build_table(CAPTURE *capture) {
+  static const uint32_t palette[4] = DISPLAY_PALETTE;
+  for (int index = 0; index < 256; index++) {
+    uint8_t *entry = capture->table + index * capture->entry_stride;
+    for (int x = 0; x < NIBBLE * capture->scale; x++) {
+      int bit = NIBBLE - 1 - x / capture->scale;
+      int color = (index >> bit & 1) | (index >> (NIBBLE + bit) & 1) << 1;
+      uint32_t rgba = palette[color];
+      if (capture->format == CAPTURE_Y4M) {
+        entry[x] = luma(rgba);
+      } else {
+        // opaque even where the display palette leaves alpha at 0
+        uint8_t *pixel = entry + 4 * x;
+        pixel[0] = rgba >> 24;
+        pixel[1] = rgba >> 16;
+        pixel[2] = rgba >> 8;
+        pixel[3] = 0xFF;
+      }
+    }
+  }
+}
+
+/**
+ * Copy a table entry with 16-byte stores, the last store may run up to 15
+ * bytes past `bytes` into space the next entry overwrites
+ */
+static void copy_entry(uint8_t *out, const uint8_t *entry, size_t bytes) {
+#ifdef __SSE2__
+  for (size_t i = 0; i < bytes; i += 16) {
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_load_si128((const __m128i *)(entry + i)));
+  }
+#else
+  memcpy(out, entry, bytes);
+#endif
+}
+
+/**
+ * Upscale a framebuffer into capture->image: every output row is assembled
+ * from table entries, then copied down for the rest of its scale rows
+ */
+static void scale_frame(CAPTURE *capture, const DISPLAY_ROW *display) {
+  for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+    uint8_t *row = capture->image + y * capture->scale * capture->row_bytes;
+    uint8_t *out = row;
+    for (int shift = DISPLAY_WIDTH - NIBBLE; shift >= 0; shift -= NIBBLE) {
+      int index = (int)(display[y] >> shift) & 0xF;
+#if DISPLAY_PLANES > 1
+      index |= ((int)(display[y + DISPLAY_HEIGHT] >> shift) & 0xF) << NIBBLE;
+#endif
+      copy_entry(out, capture->table + index * capture->entry_stride,
+                 capture->entry_bytes);
+      out += capture->entry_bytes;
+    }
+    for (int i = 1; i < capture->scale; i++) {
+      memcpy(row + i * capture->row_bytes, row, capture->row_bytes);
+    }
+  }
+}
+
+static void write_frame(CAPTURE *capture, const CAPTURE_FRAME *frame) {
+  scale_frame(capture, frame->display);
+  if (capture->format == CAPTURE_Y4M) {
+    fputs("FRAME\n", capture->out);
+  }
+  fwrite(capture->image, 1, capture->plane_size, capture->out);
+  if (capture->format == CAPTURE_Y4M) {
+    fwrite(capture->chroma, 1, capture->plane_size / 2, capture->out);
+  }
+}
+
+static void *writer(void *arg) {
+  CAPTURE *capture = arg;
+  for (;;) {
+    uint32_t tail = atomic_load_explicit(&capture->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&capture->head, memory_order_acquire)) {
+      pthread_mutex_lock(&capture->lock);
+      while (tail == atomic_load(&capture->head) &&
+             !atomic_load(&capture->closing)) {
+        pthread_cond_wait(&capture->ready, &capture->lock);
+      }
+      pthread_mutex_unlock(&capture->lock);
+      if (tail == atomic_load(&capture->head)) {
+        // closing with everything written
+        return NULL;
+      }
+    }
+    write_frame(capture, &capture->frames[tail % CAPTURE_QUEUE]);
+    atomic_store_explicit(&capture->tail, tail + 1, memory_order_release);
+    if (!capture->realtime) {
+      pthread_mutex_lock(&capture->lock);
+      pthread_cond_signal(&capture->room);
+      pthread_mutex_unlock(&capture->lock);
+    }
+  }
+}
+
+/**
+ * @brief start a capture
+ * @param  *file_name: output file, `-` for stdout
+ * @param  format: Y4M or raw RGBA
+ * @param  scale: whole upscaling factor, at least 1
+ * @param  realtime: drop frames the writer can't keep up with, for paced
+ * runs; offline runs pass 0 to keep every frame
+ * @retval the capture, NULL when the output can't be opened
+ */
+CAPTURE *capture_open(const char *file_name, enum capture_format format,
+                      int scale, int realtime) {
+  if (scale < 1) {
+    return NULL;
+  }
+  // the queue indices want their own cache lines
+  CAPTURE *capture = aligned_alloc(64, sizeof(CAPTURE));
+  if (!capture) {
+    return NULL;
+  }
+  memset(capture, 0, sizeof(CAPTURE));
+  capture->format = format;
+  capture->scale = scale;
+  capture->realtime = realtime;
+  capture->width = DISPLAY_WIDTH * scale;
+  capture->height = DISPLAY_HEIGHT * scale;
+  capture->pixel_bytes = format == CAPTURE_Y4M ? 1 : 4;
+  capture->row_bytes = (size_t)capture->width * capture->pixel_bytes;
+  capture->plane_size = capture->row_bytes * capture->height;
+  capture->entry_bytes = (size_t)NIBBLE * scale * capture->pixel_bytes;
+  capture->entry_stride = (capture->entry_bytes + 15) & ~(size_t)15;
+  capture->image = malloc(capture->plane_size + 16);
+  if (format == CAPTURE_Y4M) {
+    capture->chroma = malloc(capture->plane_size / 2);
+    // gray only: both chroma planes sit at the neutral value
+    if (capture->chroma) {
+      memset(capture->chroma, 128, capture->plane_size / 2);
+    }
+  }
+  capture->table = aligned_alloc(16, 256 * capture->entry_stride);
+  capture->out = strcmp(file_name, "-") == 0 ? stdout : fopen(file_name, "wb");
+  if (!capture->image || (format == CAPTURE_Y4M && !capture->chroma) ||
+      !capture->table || !capture->out) {
+    fprintf(stderr, "open capture error: %s\n", file_name);
+    if (capture->out && capture->out != stdout) {
+      fclose(capture->out);
+    }
+    free(capture->image);
+    free(capture->chroma);
+    free(capture->table);
+    free(capture);
+    return NULL;
+  }
+  build_table(capture);
+  if (format == CAPTURE_Y4M) {
+    fprintf(capture->out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n",
+            capture->width, capture->height);
+  }
+  pthread_mutex_init(&capture->lock, NULL);
+  pthread_cond_init(&capture->ready, NULL);
+  pthread_cond_init(&capture->room, NULL);
+  capture->threaded =
+      pthread_create(&capture->thread, NULL, writer, capture) == 0;
+  return capture;
+}
+
+/**
+ * @brief queue the current framebuffer, called once per 60 Hz frame
+ * @note a real-time capture never blocks on the writer, a frame that finds
+ * the queue full is dropped; an offline one waits for room
+ * @param  *capture: capture, may be NULL
+ * @param  *chip8: instance whose framebuffer is captured
+ * @retval None
+ */
+void capture_frame(CAPTURE *capture, const CHIP8 *chip8) {
+  if (!capture) {
+    return;
+  }
+  uint32_t head = atomic_load_explicit(&capture->head, memory_order_relaxed);
+  if (!capture->threaded) {
+    // no writer thread, write in place
+    CAPTURE_FRAME frame;
+    memcpy(frame.display, chip8->display, sizeof(frame.display));
+    write_frame(capture, &frame);
+    return;
+  }
+  if (head - atomic_load_explicit(&capture->tail, memory_order_acquire) >=
+      CAPTURE_QUEUE) {
+    if (capture->realtime) {
+      capture->dropped++;
+      return;
+    }
+    pthread_mutex_lock(&capture->lock);
+    while (head - atomic_load(&capture->tail) >= CAPTURE_QUEUE) {
+      pthread_cond_wait(&capture->room, &capture->lock);
+    }
+    pthread_mutex_unlock(&capture->lock);
+  }
+  memcpy(capture->frames[head % CAPTURE_QUEUE].display, chip8->display,
+         sizeof(chip8->display));
+  atomic_store_explicit(&capture->head, head + 1, memory_order_release);
+  pthread_mutex_lock(&capture->lock);
+  pthread_cond_signal(&capture->ready);
+  pthread_mutex_unlock(&capture->lock);
+}
+
+/**
+ * @brief write out the queued frames and close the capture
+ * @param  *capture: capture, may be NULL
+ * @retval number of frames dropped because the writer fell behind
+ */
+uint64_t capture_close(CAPTURE *capture) {
+  if (!capture) {
+    return 0;
+  }
+  if (capture->threaded) {
+    pthread_mutex_lock(&capture->lock);
+    atomic_store(&capture->closing, 1);
+    pthread_cond_signal(&capture->ready);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->thread, NULL);
+  }
+  pthread_mutex_destroy(&capture->lock);
+  pthread_cond_destroy(&capture->ready);
+  pthread_cond_destroy(&capture->room);
+  if (capture->out == stdout) {
+    fflush(stdout);
+  } else {
+    fclose(capture->out);
+  }
+  uint64_t dropped = capture->dropped;
+  free(capture->image);
+  free(capture->chroma);
+  free(capture->table);
+  free(capture);
+  return dropped;
+}
@@ -0,0 +1,36 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+// frames buffered between the emulation and the writer thread
+#define CAPTURE_QUEUE 64
+
+enum capture_format {
+  CAPTURE_Y4M,   // YUV4MPEG2 4:2:0 at 60 fps, for ffmpeg and friends
+  CAPTURE_RGBA,  // bare frames of 8-bit RGBA
+};
+
+/**
+ * Frame capture: every frame handed to capture_frame() is upscaled by a whole
+ * factor with nearest-neighbor sampling and written to a file or stdout.
+ * Scaling and writing run on a thread of their own, capture_frame() only
+ * copies the framebuffer into a queue. A real-time capture never waits for the
+ * writer, frames that find the queue full are dropped and counted; an offline
+ * capture keeps every frame and waits for room instead.
+ */
+typedef struct capture CAPTURE;
+
+enum capture_format capture_format_of(const char *file_name);
+
+CAPTURE *capture_open(const char *file_name, enum capture_format format,
+                      int scale, int realtime);
+
+void capture_frame(CAPTURE *capture, const CHIP8 *chip8);
+
+uint64_t capture_close(CAPTURE *capture);
+
+#endif  //__CAPTURE_H__
@@ -1,8 +1,15 @@
 #include "chip8.h"
 
+#include <pthread.h>
 #include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#include "port.h"
+#include "profile.h"
+#ifdef CHIP8_AOT
+#include "aot.h"
+#endif
 
 uint8_t chip8_fontset[FONTSET_SIZE] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0,  // 0
@@ -23,10 +30,30 @@ uint8_t chip8_fontset[FONTSET_SIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80   // F
 };
 
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+uint8_t chip8_big_fontset[BIG_FONTSET_SIZE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,  // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,  // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,  // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,  // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,  // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,  // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,  // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,  // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,  // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,  // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,  // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,  // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,  // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0   // F
+};
+#endif
+
 long get_file_size(FILE *rom_file) {
   if (rom_file == NULL) {
-    printf("open rom error\n");
-    return 1;
+    return -1;
   }
   fseek(rom_file, 0L, SEEK_END);
   long file_size = ftell(rom_file);
@@ -44,175 +71,938 @@ void print_hex(uint8_t *buffer, size_t size) {
   printf("\n");
 }
 
-CHIP8 *chip8_init() {
-  srand((unsigned)time(NULL));
-  CHIP8 *chip8 = malloc(sizeof(CHIP8));
+// private copy of one page, memory first so that pages[] points at the block
+typedef struct chip8_page {
+  uint8_t mem[MEM_PAGE_SIZE];
+  CHIP8_INST decoded[MEM_PAGE_SIZE];
+} CHIP8_PAGE;
+
+static void opcode_predecode(CHIP8 *chip8, const CHIP8_INST *inst);
+static void opcode_straddle(CHIP8 *chip8, const CHIP8_INST *inst);
+
+/**
+ * Build a memory image. With `map`, whole pages of the ROM are read where
+ * they are and only a last partial page is copied, padded with zeros.
+ */
+static CHIP8_IMAGE *image_build(const uint8_t *rom, size_t size,
+                                uint32_t quirks, uint8_t map) {
+  if (size >= MEM_SIZE - MEM_START) {
+    printf("memory overflow");
+    return NULL;
+  }
+  CHIP8_IMAGE *image = calloc(1, sizeof(CHIP8_IMAGE));
+  if (!image) {
+    return NULL;
+  }
+  image->quirks = quirks & QUIRKS_ALL;
+  memcpy(image->mem + FONTSET_MEM_START, chip8_fontset, FONTSET_SIZE);
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+  memcpy(image->mem + BIG_FONTSET_MEM_START, chip8_big_fontset,
+         BIG_FONTSET_SIZE);
+#endif
+  // MEM_START is on a page boundary
+  size_t mapped = map ? size - size % MEM_PAGE_SIZE : 0;
+  if (size > mapped) {
+    memcpy(image->mem + MEM_START + mapped, rom + mapped, size - mapped);
+  }
+  for (int page = 0; page < MEM_PAGES; page++) {
+    size_t offset = page * MEM_PAGE_SIZE;
+    image->pages[page] = offset >= MEM_START && offset - MEM_START < mapped
+                             ? rom + offset - MEM_START
+                             : image->mem + offset;
+  }
+  for (uint32_t addr = 0; addr < MEM_SIZE; addr++) {
+    uint32_t next = (addr + 1) & (MEM_SIZE - 1);
+    uint16_t opcode =
+        image->pages[addr / MEM_PAGE_SIZE][addr % MEM_PAGE_SIZE] << 8 |
+        image->pages[next / MEM_PAGE_SIZE][next % MEM_PAGE_SIZE];
+    chip8_decode(opcode, image->quirks, &image->decoded[addr]);
+    // the instruction there also reads the next page, which may not stay the
+    // image's
+    if (addr % MEM_PAGE_SIZE == MEM_PAGE_SIZE - 1) {
+      image->decoded[addr].func = opcode_straddle;
+    }
+  }
+  return image;
+}
+
+/**
+ * @brief build a memory image: fonts, the ROM at MEM_START, and every address
+ * decoded
+ * @param  *rom: ROM bytes, may be NULL when size is 0
+ * @param  size: ROM size
+ * @param  quirks: QUIRK_* flags the ROM is run with
+ * @retval the image, NULL when the ROM doesn't fit or out of memory
+ */
+CHIP8_IMAGE *chip8_image_new(const uint8_t *rom, size_t size,
+                             uint32_t quirks) {
+  return image_build(rom, size, quirks, 0);
+}
+
+/**
+ * @brief build a memory image that reads the ROM where it is, without a copy
+ * @note for ROMs in memory that outlives the image, like a mapped pack.
+ * Instances still copy a page before they write to it.
+ * @param  *rom: ROM bytes, must outlive the image
+ * @param  size: ROM size
+ * @param  quirks: QUIRK_* flags the ROM is run with
+ * @retval the image, NULL when the ROM doesn't fit or out of memory
+ */
+CHIP8_IMAGE *chip8_image_map(const uint8_t *rom, size_t size,
+                             uint32_t quirks) {
+  return image_build(rom, size, quirks, 1);
+}
+
+void chip8_image_free(CHIP8_IMAGE *image) { free(image); }
+
+// fonts only, one per set of quirks, shared by every instance from
+// chip8_init_quirks() and built the first time it is asked for
+static CHIP8_IMAGE *blank_images[QUIRKS_ALL + 1];
+static pthread_mutex_t blank_images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief create an instance with nothing loaded and no quirks, load a ROM into
+ * it with chip8_load_rom() or chip8_load_bytes()
+ * @retval the instance, NULL when out of memory
+ */
+CHIP8 *chip8_init() { return chip8_init_quirks(0); }
+
+/**
+ * @brief create an instance with nothing loaded
+ * @param  quirks: QUIRK_* flags, see chip8_parse_quirks()
+ * @retval the instance, NULL when out of memory
+ */
+CHIP8 *chip8_init_quirks(uint32_t quirks) {
+  quirks &= QUIRKS_ALL;
+  pthread_mutex_lock(&blank_images_lock);
+  if (!blank_images[quirks]) {
+    blank_images[quirks] = chip8_image_new(NULL, 0, quirks);
+  }
+  CHIP8_IMAGE *image = blank_images[quirks];
+  pthread_mutex_unlock(&blank_images_lock);
+  return image ? chip8_init_image(image) : NULL;
+}
+
+static const struct {
+  const char *name;
+  uint32_t quirks;
+} QUIRK_PROFILES[] = {
+    {"default", 0},
+    {"vip", QUIRKS_VIP},
+    {"schip", QUIRKS_SCHIP},
+    {"xo", QUIRKS_XO},
+};
+
+/**
+ * @brief read quirks from the command line: a profile name (default, vip,
+ * schip, xo) or a number of QUIRK_* flags
+ * @param  *text: profile name or number
+ * @param  *quirks: set to the quirks
+ * @retval 0 when the text is neither
+ */
+uint8_t chip8_parse_quirks(const char *text, uint32_t *quirks) {
+  for (size_t i = 0; i < sizeof(QUIRK_PROFILES) / sizeof(QUIRK_PROFILES[0]);
+       i++) {
+    if (strcmp(text, QUIRK_PROFILES[i].name) == 0) {
+      *quirks = QUIRK_PROFILES[i].quirks;
+      return 1;
+    }
+  }
+  char *end;
+  unsigned long value = strtoul(text, &end, 0);
+  if (!*text || *end || value > QUIRKS_ALL) {
+    return 0;
+  }
+  *quirks = value;
+  return 1;
+}
+
+/**
+ * @brief create an instance running from a shared memory image
+ * @note the instance only allocates the pages it writes to
+ * @param  *image: fonts and ROM, must outlive the instance
+ * @retval the instance, NULL when out of memory
+ */
+CHIP8 *chip8_init_image(const CHIP8_IMAGE *image) {
+  CHIP8 *chip8 = aligned_alloc(_Alignof(CHIP8), sizeof(CHIP8));
+  if (!chip8) {
+    return NULL;
+  }
   memset(chip8, 0, sizeof(CHIP8));
-  chip8->pc = MEM_START;
-  // init font
-  for (int i = 0; i < FONTSET_SIZE; i++) {
-    chip8->mem[FONTSET_MEM_START + i] = chip8_fontset[i];
+  chip8->image = image;
+  // image pages are only ever read through these, chip8_write() copies first
+  for (int page = 0; page < MEM_PAGES; page++) {
+    chip8->pages[page] = (uint8_t *)image->pages[page];
+    chip8->decoded_pages[page] =
+        (CHIP8_INST *)image->decoded + page * MEM_PAGE_SIZE;
   }
+  chip8->pc = MEM_START;
+  chip8_seed(chip8, (uint32_t)time(NULL));
+#if CHIP8_VARIANT == CHIP8_XO
+  chip8->planes = 1;
+  chip8->pitch = 64;
+  // a plain square wave until a program loads its own pattern
+  memset(chip8->pattern, 0xF0, sizeof(chip8->pattern));
+#endif
   chip8->state = SYS_RUNNING;
+#ifdef CHIP8_AOT
+  aot_attach(chip8);
+#endif
   return chip8;
 }
 
+/**
+ * @brief free an instance and its private pages, not the image
+ * @param  *chip8: instance, may be NULL
+ * @retval None
+ */
+void chip8_free(CHIP8 *chip8) {
+  if (!chip8) {
+    return;
+  }
+#ifdef CHIP8_AOT
+  if (aot_machine == chip8) {
+    aot_machine = NULL;
+  }
+#endif
+  for (int page = 0; page < MEM_PAGES; page++) {
+    if (PAGE_DIRTY(chip8, page)) {
+      free(chip8->pages[page]);
+    }
+  }
+  free(chip8);
+}
+
+/**
+ * Give the instance its own copy of a page before it writes to it
+ */
+static uint8_t own_page(CHIP8 *chip8, int page) {
+  if (PAGE_DIRTY(chip8, page)) {
+    return 1;
+  }
+  CHIP8_PAGE *copy = malloc(sizeof(CHIP8_PAGE));
+  if (!copy) {
+    return 0;
+  }
+  memcpy(copy->mem, chip8->pages[page], MEM_PAGE_SIZE);
+  memcpy(copy->decoded, chip8->decoded_pages[page], sizeof(copy->decoded));
+  chip8->pages[page] = copy->mem;
+  chip8->decoded_pages[page] = copy->decoded;
+  chip8->dirty[page / 32] |= 1u << (page % 32);
+  return 1;
+}
+
+/**
+ * @brief read from memory
+ * @param  *chip8: instance
+ * @param  addr: first byte read, the read wraps around at MEM_SIZE
+ * @param  *bytes: output
+ * @param  len: number of bytes
+ * @retval None
+ */
+void chip8_read(const CHIP8 *chip8, uint16_t addr, uint8_t *bytes,
+                uint32_t len) {
+  uint32_t done = 0;
+  while (done < len) {
+    uint16_t at = (addr + done) & (MEM_SIZE - 1);
+    uint32_t offset = at % MEM_PAGE_SIZE;
+    uint32_t n = MEM_PAGE_SIZE - offset;
+    n = n < len - done ? n : len - done;
+    memcpy(bytes + done, chip8->pages[at / MEM_PAGE_SIZE] + offset, n);
+    done += n;
+  }
+}
+
+/**
+ * @brief write to memory, the pages still shared with the image are copied
+ * first and the instructions decoded from the written bytes are dropped
+ * @param  *chip8: instance
+ * @param  addr: first byte written, the write wraps around at MEM_SIZE
+ * @param  *bytes: data
+ * @param  len: number of bytes
+ * @retval None
+ */
+void chip8_write(CHIP8 *chip8, uint16_t addr, const uint8_t *bytes,
+                 uint32_t len) {
+  uint16_t start = addr & (MEM_SIZE - 1);
+  int page = start / MEM_PAGE_SIZE;
+  uint32_t first = start % MEM_PAGE_SIZE;
+  if (first + len <= MEM_PAGE_SIZE && PAGE_DIRTY(chip8, page)) {
+    // the usual case, a short write inside a page the instance already owns
+    uint8_t *mem = chip8->pages[page];
+    CHIP8_INST *decoded = chip8->decoded_pages[page];
+    for (uint32_t i = 0; i < len; i++) {
+      mem[first + i] = bytes[i];
+      decoded[first + i].func = opcode_predecode;
+    }
+    // the instruction starting one byte before addr also reads mem[addr]
+    int before = (start - 1) & (MEM_SIZE - 1);
+    if (PAGE_DIRTY(chip8, before / MEM_PAGE_SIZE)) {
+      DECODED(chip8, before)->func = opcode_predecode;
+    }
+#ifdef CHIP8_AOT
+    aot_invalidate(chip8, addr, len);
+#endif
+    return;
+  }
+  uint32_t done = 0;
+  while (done < len) {
+    uint16_t at = (addr + done) & (MEM_SIZE - 1);
+    page = at / MEM_PAGE_SIZE;
+    uint32_t offset = at % MEM_PAGE_SIZE;
+    uint32_t n = MEM_PAGE_SIZE - offset;
+    n = n < len - done ? n : len - done;
+    // out of memory, the rest of the write is lost
+    if (!own_page(chip8, page)) {
+      break;
+    }
+    memcpy(chip8->pages[page] + offset, bytes + done, n);
+    done += n;
+  }
+  chip8_invalidate(chip8, addr, done);
+}
+
+/**
+ * @brief drop the private copy of a page and read the image's again
+ * @param  *chip8: instance
+ * @param  page: page number
+ * @retval None
+ */
+void chip8_share_page(CHIP8 *chip8, int page) {
+  if (!PAGE_DIRTY(chip8, page)) {
+    return;
+  }
+  free(chip8->pages[page]);
+  chip8->pages[page] = (uint8_t *)chip8->image->pages[page];
+  chip8->decoded_pages[page] =
+      (CHIP8_INST *)chip8->image->decoded + page * MEM_PAGE_SIZE;
+  chip8->dirty[page / 32] &= ~(1u << (page % 32));
+  chip8_invalidate(chip8, page * MEM_PAGE_SIZE, MEM_PAGE_SIZE);
+}
+
 uint8_t chip8_load_rom(CHIP8 *chip8, const char *rom_name) {
   FILE *rom_file = fopen(rom_name, "r");
   long file_size = get_file_size(rom_file);
+  if (file_size < 0) {
+    printf("open rom error\n");
+    if (rom_file) {
+      fclose(rom_file);
+    }
+    return 0;
+  }
   if (file_size >= MEM_SIZE - MEM_START) {
     printf("memory overflow");
+    fclose(rom_file);
     return 0;
   }
 
-  uint8_t *rom = chip8->mem + MEM_START;  // 512
-  size_t result = fread(rom, 1, file_size, rom_file);
+  uint8_t *rom = malloc(file_size + 1);
+  size_t result = rom ? fread(rom, 1, file_size, rom_file) : 0;
+  fclose(rom_file);
   if (result != file_size) {
     printf("read rom error\n");
+    free(rom);
     return 0;
   }
   // print_hex(rom, file_size);
-  fclose(rom_file);
+  chip8_write(chip8, MEM_START, rom, file_size);
+  free(rom);
+#ifdef CHIP8_AOT
+  aot_attach(chip8);
+#endif
   return 1;
 }
 
-void chip8_cycle(CHIP8 *chip8) {
-  // fetch and execute
-  uint16_t opcode =
-      (0xFF00 & (chip8->mem[chip8->pc] << 8)) | chip8->mem[chip8->pc + 1];
-  chip8->opcode = opcode;
-  chip8->pc += 2;
+/**
+ * Copy a ROM image already in memory to MEM_START
+ */
+uint8_t chip8_load_bytes(CHIP8 *chip8, const uint8_t *rom, size_t size) {
+  if (size >= MEM_SIZE - MEM_START) {
+    printf("memory overflow");
+    return 0;
+  }
+  chip8_write(chip8, MEM_START, rom, size);
+#ifdef CHIP8_AOT
+  aot_attach(chip8);
+#endif
+  return 1;
+}
+
+/**
+ * Seed the instance's random number generator used by CXNN, the same seed
+ * always gives the same sequence
+ */
+void chip8_seed(CHIP8 *chip8, uint32_t seed) {
+  // spread nearby seeds apart, xorshift state must never be zero
+  chip8->rng = seed * 0x9E3779B9u + 0x7F4A7C15u;
+  if (!chip8->rng) {
+    chip8->rng = 1;
+  }
+}
+
+/**
+ * Next byte of the per-instance xorshift32 generator
+ */
+static uint8_t chip8_random(CHIP8 *chip8) {
+  uint32_t x = chip8->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  chip8->rng = x;
+  return x >> 24;
+}
+
+/**
+ * Pressed keys as a bit mask, bit i for key i
+ */
+uint16_t chip8_key_mask(CHIP8 *chip8) {
+  uint16_t mask = 0;
+  for (int i = 0; i < KEY_SIZE; i++) {
+    mask |= (chip8->keys[i] ? 1 : 0) << i;
+  }
+  return mask;
+}
+
+/**
+ * Press exactly the keys set in `mask`
+ */
+void chip8_set_keys(CHIP8 *chip8, uint16_t mask) {
+  for (int i = 0; i < KEY_SIZE; i++) {
+    chip8->keys[i] = (mask >> i) & 1;
+  }
+}
+
+/**
+ * Placeholder for opcodes the core doesn't implement (0NNN machine code
+ * routines and invalid encodings)
+ */
+static void opcode_nop(CHIP8 *chip8, const CHIP8_INST *inst) {}
+
+const CHIP8_HANDLER chip8_handlers[] = {
+    {opcode_00E0, "00E0"}, {opcode_00EE, "00EE"}, {opcode_1NNN, "1NNN"},
+    {opcode_2NNN, "2NNN"}, {opcode_3XNN, "3XNN"}, {opcode_4XNN, "4XNN"},
+    {opcode_5XY0, "5XY0"}, {opcode_6XNN, "6XNN"}, {opcode_7XNN, "7XNN"},
+    {opcode_8XY0, "8XY0"}, {opcode_8XY1, "8XY1"}, {opcode_8XY2, "8XY2"},
+    {opcode_8XY3, "8XY3"}, {opcode_8XY4, "8XY4"}, {opcode_8XY5, "8XY5"},
+    {opcode_8XY6, "8XY6"}, {opcode_8XY7, "8XY7"}, {opcode_8XYE, "8XYE"},
+    {opcode_9XY0, "9XY0"}, {opcode_ANNN, "ANNN"}, {opcode_BNNN, "BNNN"},
+    {opcode_CXNN, "CXNN"}, {opcode_DXYN, "DXYN"}, {opcode_EX9E, "EX9E"},
+    {opcode_EXA1, "EXA1"}, {opcode_FX07, "FX07"}, {opcode_FX0A, "FX0A"},
+    {opcode_FX15, "FX15"}, {opcode_FX18, "FX18"}, {opcode_FX1E, "FX1E"},
+    {opcode_FX29, "FX29"}, {opcode_FX33, "FX33"}, {opcode_FX55, "FX55"},
+    {opcode_FX65, "FX65"}, {opcode_8XY1_VF, "8XY1_VF"},
+    {opcode_8XY2_VF, "8XY2_VF"}, {opcode_8XY3_VF, "8XY3_VF"},
+    {opcode_8XY6_VY, "8XY6_VY"}, {opcode_8XYE_VY, "8XYE_VY"},
+    {opcode_BXNN, "BXNN"}, {opcode_DXYN_WRAP, "DXYN_WRAP"},
+    {opcode_FX55_I, "FX55_I"}, {opcode_FX65_I, "FX65_I"},
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+    {opcode_00CN, "00CN"}, {opcode_00FB, "00FB"}, {opcode_00FC, "00FC"},
+    {opcode_00FD, "00FD"}, {opcode_00FE, "00FE"}, {opcode_00FF, "00FF"},
+    {opcode_DXY0, "DXY0"}, {opcode_DXY0_WRAP, "DXY0_WRAP"},
+    {opcode_FX30, "FX30"}, {opcode_FX75, "FX75"}, {opcode_FX85, "FX85"},
+#endif
+#if CHIP8_VARIANT == CHIP8_XO
+    {opcode_00DN, "00DN"}, {opcode_5XY2, "5XY2"}, {opcode_5XY3, "5XY3"},
+    {opcode_F000, "F000"}, {opcode_FN01, "FN01"}, {opcode_F002, "F002"},
+    {opcode_FX3A, "FX3A"},
+#endif
+};
+const size_t chip8_handler_count =
+    sizeof(chip8_handlers) / sizeof(chip8_handlers[0]);
+
+/**
+ * Name of a handler, "nop" for invalid instructions
+ */
+const char *chip8_handler_name(opcode_func func) {
+  for (size_t i = 0; i < chip8_handler_count; i++) {
+    if (chip8_handlers[i].func == func) {
+      return chip8_handlers[i].name;
+    }
+  }
+  return "nop";
+}
+
+/**
+ * Decode an opcode into its handler and operands, the handler already
+ * implements the quirks so none of them costs a branch at run time
+ */
+void chip8_decode(uint16_t opcode, uint32_t quirks, CHIP8_INST *inst) {
+  opcode_func func = opcode_nop;
   byte type = (0xF000 & opcode) >> 12;
   switch (type) {
     case 0x0:
       if (opcode == 0x00E0) {
-        OPCODE(00E0);
+        func = opcode_00E0;
       } else if (opcode == 0x00EE) {
         // 00EE return;
-        OPCODE(00EE);
+        func = opcode_00EE;
+      }
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+      else if ((opcode & 0xFFF0) == 0x00C0) {
+        func = opcode_00CN;
+      } else if (opcode == 0x00FB) {
+        func = opcode_00FB;
+      } else if (opcode == 0x00FC) {
+        func = opcode_00FC;
+      } else if (opcode == 0x00FD) {
+        func = opcode_00FD;
+      } else if (opcode == 0x00FE) {
+        func = opcode_00FE;
+      } else if (opcode == 0x00FF) {
+        func = opcode_00FF;
       }
+#endif
+#if CHIP8_VARIANT == CHIP8_XO
+      else if ((opcode & 0xFFF0) == 0x00D0) {
+        func = opcode_00DN;
+      }
+#endif
       break;
     case 0x1:
       // 1NNN goto NNN;
-      OPCODE(1NNN);
+      func = opcode_1NNN;
       break;
     case 0x2:
       // 2NNN *(0xNNN)();
-      OPCODE(2NNN);
+      func = opcode_2NNN;
       break;
     case 0x3:
       // 3XNN if (Vx == NN)
-      OPCODE(3XNN);
+      func = opcode_3XNN;
       break;
     case 0x4:
       // 4XNN if (Vx != NN)
-      OPCODE(4XNN);
+      func = opcode_4XNN;
       break;
     case 0x5:
       // 5XY0 if (Vx == Vy)
-      OPCODE(5XY0);
+      func = opcode_5XY0;
+#if CHIP8_VARIANT == CHIP8_XO
+      if (N(opcode) == 0x2) {
+        func = opcode_5XY2;
+      } else if (N(opcode) == 0x3) {
+        func = opcode_5XY3;
+      }
+#endif
       break;
     case 0x6:
       // 6XNN Vx = NN
-      OPCODE(6XNN);
+      func = opcode_6XNN;
       break;
     case 0x7:
       // 7XNN Vx += NN, not affect VF
-      OPCODE(7XNN);
+      func = opcode_7XNN;
       break;
     case 0x8:
-      switch (N(_OPCODE)) {
+      switch (N(opcode)) {
         case 0x0:
-          OPCODE(8XY0);
+          func = opcode_8XY0;
           break;
         case 0x1:
-          OPCODE(8XY1);
+          func = quirks & QUIRK_VF_RESET ? opcode_8XY1_VF : opcode_8XY1;
           break;
         case 0x2:
-          OPCODE(8XY2);
+          func = quirks & QUIRK_VF_RESET ? opcode_8XY2_VF : opcode_8XY2;
           break;
         case 0x3:
-          OPCODE(8XY3);
+          func = quirks & QUIRK_VF_RESET ? opcode_8XY3_VF : opcode_8XY3;
           break;
         case 0x4:
-          OPCODE(8XY4);
+          func = opcode_8XY4;
           break;
         case 0x5:
-          OPCODE(8XY5);
+          func = opcode_8XY5;
           break;
         case 0x6:
-          OPCODE(8XY6);
+          func = quirks & QUIRK_SHIFT_VY ? opcode_8XY6_VY : opcode_8XY6;
           break;
         case 0x7:
-          OPCODE(8XY7);
+          func = opcode_8XY7;
           break;
         case 0xE:
-          OPCODE(8XYE);
+          func = quirks & QUIRK_SHIFT_VY ? opcode_8XYE_VY : opcode_8XYE;
           break;
       }
       break;
     case 0x9:
       // 9XY0 if (Vx != Vy)
-      OPCODE(9XY0);
+      func = opcode_9XY0;
       break;
     case 0xA:
       // ANNN I = NNN
-      OPCODE(ANNN);
+      func = opcode_ANNN;
       break;
     case 0xB:
-      OPCODE(BNNN);
+      func = quirks & QUIRK_JUMP_VX ? opcode_BXNN : opcode_BNNN;
       break;
     case 0xC:
-      OPCODE(CXNN);
+      func = opcode_CXNN;
       break;
     case 0xD:
       // DXYN draw(Vx, Vy, N)
       // Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels
       // and a height of N pixels.
-      OPCODE(DXYN);
+      func = quirks & QUIRK_WRAP ? opcode_DXYN_WRAP : opcode_DXYN;
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+      if (N(opcode) == 0) {
+        func = quirks & QUIRK_WRAP ? opcode_DXY0_WRAP : opcode_DXY0;
+      }
+#endif
       break;
     case 0xE:
-      if (NN(_OPCODE) == 0x9E) {
-        OPCODE(EX9E);
-      } else if (NN(_OPCODE) == 0xA1) {
-        OPCODE(EXA1);
+      if (NN(opcode) == 0x9E) {
+        func = opcode_EX9E;
+      } else if (NN(opcode) == 0xA1) {
+        func = opcode_EXA1;
       }
       break;
     case 0xF:
-      switch (NN(_OPCODE)) {
+      switch (NN(opcode)) {
         case 0x07:
-          OPCODE(FX07);
+          func = opcode_FX07;
           break;
         case 0x0A:
           // FX0A Vx = get_key()
-          OPCODE(FX0A);
+          func = opcode_FX0A;
           break;
         case 0x15:
-          OPCODE(FX15);
+          func = opcode_FX15;
           break;
         case 0x18:
-          OPCODE(FX18);
+          func = opcode_FX18;
           break;
         case 0x1E:
-          OPCODE(FX1E);
+          func = opcode_FX1E;
           break;
         case 0x29:
-          OPCODE(FX29);
+          func = opcode_FX29;
           break;
         case 0x33:
-          OPCODE(FX33);
+          func = opcode_FX33;
           break;
         case 0x55:
-          OPCODE(FX55);
+          func = quirks & QUIRK_MEMORY_I ? opcode_FX55_I : opcode_FX55;
           break;
         case 0x65:
-          OPCODE(FX65);
+          func = quirks & QUIRK_MEMORY_I ? opcode_FX65_I : opcode_FX65;
+          break;
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+        case 0x30:
+          func = opcode_FX30;
+          break;
+        case 0x75:
+          func = opcode_FX75;
           break;
+        case 0x85:
+          func = opcode_FX85;
+          break;
+#endif
+#if CHIP8_VARIANT == CHIP8_XO
+        case 0x00:
+          if (opcode == 0xF000) {
+            func = opcode_F000;
+          }
+          break;
+        case 0x01:
+          func = opcode_FN01;
+          break;
+        case 0x02:
+          if (opcode == 0xF002) {
+            func = opcode_F002;
+          }
+          break;
+        case 0x3A:
+          func = opcode_FX3A;
+          break;
+#endif
       }
       break;
     default:
       break;
   }
+  inst->func = func;
+  inst->opcode = opcode;
+  inst->nnn = NNN(opcode);
+  inst->x = X(opcode);
+  inst->y = Y(opcode);
+  inst->n = N(opcode);
+  inst->nn = NN(opcode);
+}
+
+static uint16_t fetch(CHIP8 *chip8, uint16_t addr) {
+  return MEM_READ(chip8, addr) << 8 | MEM_READ(chip8, addr + 1);
+}
+
+/**
+ * Initial handler of every decoded entry of a private page: decode the two
+ * bytes at the entry's address, cache the result and execute it
+ */
+static void opcode_predecode(CHIP8 *chip8, const CHIP8_INST *inst) {
+  CHIP8_INST *entry = (CHIP8_INST *)inst;
+  // the dispatch loops move pc past an instruction before running it
+  uint16_t opcode = fetch(chip8, chip8->pc - 2);
+  chip8_decode(opcode, chip8->image->quirks, entry);
+  chip8->opcode = opcode;
+  entry->func(chip8, entry);
+}
+
+/**
+ * Handler of the last address of every image page: the instruction there also
+ * reads the first byte of the next page, which may be rewritten while this
+ * page stays shared, so it is decoded again on every run
+ */
+static void opcode_straddle(CHIP8 *chip8, const CHIP8_INST *inst) {
+  CHIP8_INST decoded;
+  chip8_decode(fetch(chip8, chip8->pc - 2), chip8->image->quirks, &decoded);
+  chip8->opcode = decoded.opcode;
+  decoded.func(chip8, &decoded);
+}
+
+/**
+ * Drop the decoded instructions overlapping [addr, addr + len), must be called
+ * after anything writes to mem. Pages shared with the image never change and
+ * keep theirs.
+ */
+void chip8_invalidate(CHIP8 *chip8, uint16_t addr, uint32_t len) {
+  // the instruction starting one byte before addr also reads mem[addr]
+  uint16_t at = (addr - 1) & (MEM_SIZE - 1);
+  uint32_t left = len + 1;
+  while (left) {
+    int page = at / MEM_PAGE_SIZE;
+    uint32_t offset = at % MEM_PAGE_SIZE;
+    uint32_t n = MEM_PAGE_SIZE - offset;
+    n = n < left ? n : left;
+    if (PAGE_DIRTY(chip8, page)) {
+      for (uint32_t i = 0; i < n; i++) {
+        chip8->decoded_pages[page][offset + i].func = opcode_predecode;
+      }
+    }
+    at = (at + n) & (MEM_SIZE - 1);
+    left -= n;
+  }
+#ifdef CHIP8_AOT
+  aot_invalidate(chip8, addr, len);
+#endif
+}
+
+void chip8_cycle(CHIP8 *chip8) {
+  // fetch and execute the predecoded instruction
+  uint16_t pc = chip8->pc & (MEM_SIZE - 1);
+  const CHIP8_INST *inst = DECODED(chip8, pc);
+  chip8->opcode = inst->opcode;
+  chip8->pc += 2;
+  inst->func(chip8, inst);
+  PROFILE_EXEC(chip8, pc, inst);
+}
+
+/**
+ * Execute `cycles` instructions back to back, cheaper than calling
+ * chip8_cycle() in a loop. AOT builds run translated blocks where they can.
+ */
+void chip8_run(CHIP8 *chip8, uint32_t cycles) {
+#ifdef CHIP8_AOT
+  if (chip8 == aot_machine) {
+    cycles = aot_run(chip8, cycles);
+  }
+#endif
+  while (cycles--) {
+    uint16_t pc = chip8->pc & (MEM_SIZE - 1);
+    const CHIP8_INST *inst = DECODED(chip8, pc);
+    chip8->pc += 2;
+    inst->func(chip8, inst);
+    PROFILE_EXEC(chip8, pc, inst);
+  }
+}
+
+/**
+ * Machine cycles the COSMAC VIP interpreter spends on `opcode`, about 40 of
+ * them fetching and decoding. A model rounded from the VIP's timings, not a
+ * cycle-exact count; SUPER-CHIP and XO-CHIP instructions cost as much as the
+ * VIP instructions of their group. DXYN is the cost of drawing after the
+ * vertical blank it waits for.
+ */
+static uint32_t vip_cycles(uint16_t opcode) {
+  switch (opcode >> 12) {
+    case 0x0:
+      return opcode == 0x00E0 ? 64 : 63;
+    case 0x1:
+    case 0x2:
+    case 0xB:
+      return 63;
+    case 0x3:
+    case 0x4:
+    case 0xA:
+      return 52;
+    case 0x5:
+    case 0x9:
+    case 0xE:
+      return 56;
+    case 0x6:
+      return 46;
+    case 0x7:
+      return 50;
+    case 0x8:
+      return 84;
+    case 0xC:
+      return 76;
+    case 0xD:
+      return 28 + 46 * N(opcode);
+  }
+  switch (NN(opcode)) {
+    case 0x1E:
+      return 59;
+    case 0x29:
+      return 60;
+    case 0x33:
+      return 244;
+    case 0x55:
+    case 0x65:
+      return 54 + 8 * (X(opcode) + 1);
+  }
+  return 50;
+}
+
+/**
+ * @brief run on the COSMAC VIP clock until the current frame is over:
+ * instructions cost the machine cycles they take on the VIP instead of one
+ * frequency / 60th of a frame each, and a sprite waits for the vertical blank,
+ * which ends the frame
+ * @note the frame is over once vip_clock reaches VIP_FRAME_CYCLES,
+ * chip8_timer() starts the next one with the cycles the last instruction ran
+ * into it. Instances run this way only when their quirks have
+ * QUIRK_VIP_CLOCK, the frontends check.
+ * @param  *chip8: instance
+ * @param  cycles: most instructions to run
+ * @retval number of instructions executed
+ */
+uint32_t chip8_run_vip(CHIP8 *chip8, uint32_t cycles) {
+  uint32_t done = 0;
+  while (done < cycles && chip8->vip_clock < VIP_FRAME_CYCLES) {
+    uint16_t pc = chip8->pc & (MEM_SIZE - 1);
+    const CHIP8_INST *inst = DECODED(chip8, pc);
+    chip8->opcode = inst->opcode;
+    chip8->pc += 2;
+    inst->func(chip8, inst);
+    PROFILE_EXEC(chip8, pc, inst);
+    done++;
+    // the decoding stubs leave the opcode they ran in chip8->opcode
+    uint16_t opcode = chip8->opcode;
+    if ((opcode >> 12) == 0xD) {
+      chip8->vip_clock = VIP_FRAME_CYCLES;
+    }
+    chip8->vip_clock += vip_cycles(opcode);
+  }
+  return done;
+}
+
+
+#if CHIP8_VARIANT == CHIP8_XO
+// skipping over F000 NNNN skips both of its words
+#define SKIP_NEXT(chip8) \
+  ((chip8)->pc += fetch((chip8), (chip8)->pc) == 0xF000 ? 4 : 2)
+#else
+#define SKIP_NEXT(chip8) ((chip8)->pc += 2)
+#endif
+
+// bit mask of the planes drawing, scrolling and clearing apply to
+#if CHIP8_VARIANT == CHIP8_XO
+#define PLANE_MASK(chip8) ((chip8)->planes)
+#else
+#define PLANE_MASK(chip8) 1
+#endif
+
+/**
+ * Position of pc in a `FX07, 3X00, 1NNN` loop jumping back to the FX07,
+ * 0 to 2, or -1 when pc isn't in such a loop or is about to leave it
+ */
+static int delay_loop_phase(CHIP8 *chip8, uint16_t pc, uint16_t opcode) {
+  int phase;
+  switch (opcode >> 12) {
+    case 0xF:
+      phase = 0;
+      break;
+    case 0x3:
+      phase = 1;
+      break;
+    case 0x1:
+      phase = 2;
+      break;
+    default:
+      return -1;
+  }
+  uint16_t start = (pc - 2 * phase) & (MEM_SIZE - 1);
+  uint16_t get = fetch(chip8, start);
+  if (start >= 0x1000 || (get & 0xF0FF) != 0xF007 ||
+      fetch(chip8, start + 2) != (0x3000 | (get & 0x0F00)) ||
+      fetch(chip8, start + 4) != (0x1000 | start)) {
+    return -1;
+  }
+  // 3X00 skips the jump once VX reads 0
+  if (phase == 1 && chip8->reg[X(get)] == 0) {
+    return -1;
+  }
+  return phase;
+}
+
+/**
+ * Recognize a loop that can only end on a timer tick or a key change, so
+ * running it until the end of the current frame changes nothing but pc
+ */
+enum chip8_idle chip8_idle(CHIP8 *chip8) {
+  uint16_t pc = chip8->pc & (MEM_SIZE - 1);
+  uint16_t opcode = fetch(chip8, pc);
+  if ((opcode & 0xF0FF) == 0xF00A) {
+    // same keys opcode_FX0A looks at
+    for (byte i = 0; i < 0xF; i++) {
+      if (chip8->keys[i]) {
+        return IDLE_NONE;
+      }
+    }
+    return IDLE_KEY;
+  }
+  if (pc < 0x1000 && opcode == (0x1000 | pc)) {
+    return IDLE_HALT;
+  }
+  if (chip8->delay_timer && delay_loop_phase(chip8, pc, opcode) >= 0) {
+    return IDLE_DELAY;
+  }
+  return IDLE_NONE;
+}
+
+/**
+ * @brief fast-forward over an idle loop
+ * @note keys and timers must stay as they are for the next `cycles`
+ * instructions, the state afterwards is exactly what running them would give
+ * @param  *chip8: instance
+ * @param  cycles: instructions left before the next timer tick or input
+ * @retval `cycles` when they were skipped, 0 when the program isn't idle
+ */
+uint32_t chip8_skip_idle(CHIP8 *chip8, uint32_t cycles) {
+  uint16_t pc = chip8->pc & (MEM_SIZE - 1);
+  switch (chip8_idle(chip8)) {
+    case IDLE_KEY:
+      break;
+    case IDLE_HALT:
+      chip8->pc = pc;
+      break;
+    case IDLE_DELAY: {
+      int phase = delay_loop_phase(chip8, pc, fetch(chip8, pc));
+      uint16_t start = (pc - 2 * phase) & (MEM_SIZE - 1);
+      // FX07 runs whenever the loop passes its start
+      if (cycles > (uint32_t)(3 - phase) % 3) {
+        chip8->reg[X(fetch(chip8, start))] = chip8->delay_timer;
+      }
+      if (phase + cycles < 3) {
+        chip8->pc += 2 * cycles;
+      } else {
+        chip8->pc = start + 2 * ((phase + cycles) % 3);
+      }
+      break;
+    }
+    default:
+      return 0;
+  }
+  return cycles;
 }
 
 void chip8_timer(CHIP8 *chip8) {
@@ -223,107 +1013,221 @@ void chip8_timer(CHIP8 *chip8) {
   if (chip8->sound_timer > 0) {
     chip8->sound_timer--;
   }
+  // next frame of the VIP clock, with what the last instruction ran over
+  if (chip8->vip_clock >= VIP_FRAME_CYCLES) {
+    chip8->vip_clock -= VIP_FRAME_CYCLES;
+  }
+  PROFILE_FRAME();
+}
+
+#if DISPLAY_PLANES == 1
+#ifdef __SSE2__
+/**
+ * Expand 64 pixels of a framebuffer row into 32-bit RGBA pixels
+ */
+static void expand_word(uint64_t bits, uint32_t *rgba) {
+  // 4 pixels per store: broadcast the sprite byte, keep one bit per lane and
+  // turn it into an all-ones or all-zeros mask
+  const __m128i high = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+  const __m128i low = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+  const __m128i white = _mm_set1_epi32((int)DISPLAY_WHITE);
+  const __m128i black = _mm_set1_epi32((int)DISPLAY_BLACK);
+  __m128i *out = (__m128i *)rgba;
+  for (int i = 0; i < 8; i++) {
+    __m128i byte = _mm_set1_epi32((bits >> (56 - 8 * i)) & 0xFF);
+    __m128i mask_h = _mm_cmpeq_epi32(_mm_and_si128(byte, high), high);
+    __m128i mask_l = _mm_cmpeq_epi32(_mm_and_si128(byte, low), low);
+    _mm_storeu_si128(out++, _mm_or_si128(_mm_and_si128(mask_h, white),
+                                         _mm_andnot_si128(mask_h, black)));
+    _mm_storeu_si128(out++, _mm_or_si128(_mm_and_si128(mask_l, white),
+                                         _mm_andnot_si128(mask_l, black)));
+  }
+}
+#else
+static void expand_word(uint64_t bits, uint32_t *rgba) {
+  for (int x = 0; x < 64; x++) {
+    rgba[x] = (bits >> (63 - x)) & 1 ? DISPLAY_WHITE : DISPLAY_BLACK;
+  }
+}
+#endif
+#endif  // DISPLAY_PLANES == 1
+
+/**
+ * Expand `rows` rows of the bit-packed framebuffer into 32-bit RGBA pixels,
+ * the rows of further planes are read DISPLAY_HEIGHT rows after the first
+ */
+void chip8_display_rgba(const DISPLAY_ROW *display, int rows,
+                        uint32_t rgba[][DISPLAY_WIDTH]) {
+#if DISPLAY_PLANES == 1
+  for (int y = 0; y < rows; y++) {
+    for (int w = 0; w < DISPLAY_WIDTH / 64; w++) {
+      expand_word((uint64_t)(display[y] >> (DISPLAY_WIDTH - 64 - 64 * w)),
+                  rgba[y] + 64 * w);
+    }
+  }
+#else
+  static const uint32_t palette[4] = DISPLAY_PALETTE;
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < DISPLAY_WIDTH; x++) {
+      rgba[y][x] = palette[DISPLAY_COLOR(display, x, y)];
+    }
+  }
+#endif
+}
+
+/**
+ * @brief pack the framebuffer into DISPLAY_BYTES bytes: rows top to bottom,
+ * one plane after the other, the leftmost pixel in the top bit of a byte
+ * @note byte order independent of the host, ready for numpy.unpackbits()
+ * @param  *display: framebuffer
+ * @param  *bytes: filled with DISPLAY_BYTES bytes
+ * @retval None
+ */
+void chip8_display_bytes(const DISPLAY_ROW *display, uint8_t *bytes) {
+  for (int y = 0; y < DISPLAY_PLANES * DISPLAY_HEIGHT; y++) {
+    for (int w = 0; w < DISPLAY_WIDTH / 64; w++) {
+      uint64_t word = (uint64_t)(display[y] >> (DISPLAY_WIDTH - 64 - 64 * w));
+      for (int i = 0; i < 8; i++) {
+        *bytes++ = (uint8_t)(word >> (56 - 8 * i));
+      }
+    }
+  }
 }
 
 /**
  * Clear the screen
  */
-void opcode_00E0(CHIP8 *chip8) {
+void opcode_00E0(CHIP8 *chip8, const CHIP8_INST *inst) {
+#if DISPLAY_PLANES == 1
   memset(chip8->display, 0, sizeof(chip8->display));
+#else
+  for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+    if (PLANE_MASK(chip8) & (1 << plane)) {
+      memset(chip8->display + plane * DISPLAY_HEIGHT, 0,
+             DISPLAY_HEIGHT * sizeof(DISPLAY_ROW));
+    }
+  }
+#endif
+  chip8->display_refresh_flag = 1;
 }
 
 /**
  * Return from a subroutine
  */
-void opcode_00EE(CHIP8 *chip8) {
-  // attention please: decrease sp first
-  chip8->pc = chip8->stack[--(chip8->sp)];
+void opcode_00EE(CHIP8 *chip8, const CHIP8_INST *inst) {
+  // attention please: decrease sp first, the stack wraps around instead of
+  // running into the page tables after it
+  chip8->pc = chip8->stack[--(chip8->sp) & 15];
 }
 
 /**
  * Jump to address NNN
  */
-void opcode_1NNN(CHIP8 *chip8) {
-  chip8->pc = NNN(_OPCODE);
+void opcode_1NNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->pc = _NNN;
 }
 
 /**
  * Call subroutine at NNN
  */
-void opcode_2NNN(CHIP8 *chip8) {
-  chip8->stack[chip8->sp++] = chip8->pc;
-  chip8->pc = NNN(_OPCODE);
+void opcode_2NNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->stack[chip8->sp++ & 15] = chip8->pc;
+  chip8->pc = _NNN;
 }
 
 /**
  * Skip next instruction if VX equals NN
  */
-void opcode_3XNN(CHIP8 *chip8) {
-  if (VX(_OPCODE) == NN(_OPCODE)) {
-    chip8->pc += 2;
+void opcode_3XNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX == _NN) {
+    SKIP_NEXT(chip8);
   }
 }
 
 /**
  * Skip next instruction if VX doesn't equal NN
  */
-void opcode_4XNN(CHIP8 *chip8) {
-  if (VX(_OPCODE) != NN(_OPCODE)) {
-    chip8->pc += 2;
+void opcode_4XNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX != _NN) {
+    SKIP_NEXT(chip8);
   }
 }
 
 /**
  * Skip next instruction if VX equals VY
  */
-void opcode_5XY0(CHIP8 *chip8) {
-  if (VX(_OPCODE) == VY(_OPCODE)) {
-    chip8->pc += 2;
+void opcode_5XY0(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX == _VY) {
+    SKIP_NEXT(chip8);
   }
 }
 
 /**
  * Set VX to NN
  */
-void opcode_6XNN(CHIP8 *chip8) {
-  VX(_OPCODE) = NN(_OPCODE);
-  // printf("set V%d: %02X\n", X(_OPCODE), NN(_OPCODE));
+void opcode_6XNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX = _NN;
+  // printf("set V%d: %02X\n", _X, _NN);
 }
 
 /**
  * Add NN to VX
  */
-void opcode_7XNN(CHIP8 *chip8) {
-  VX(_OPCODE) += NN(_OPCODE);
-  // printf("add V%d: %02X\n", X(_OPCODE), NN(_OPCODE));
+void opcode_7XNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX += _NN;
+  // printf("add V%d: %02X\n", _X, _NN);
 }
 
 /**
  * Set VX to the value of VY
  */
-void opcode_8XY0(CHIP8 *chip8) { VX(_OPCODE) = VY(_OPCODE); }
+void opcode_8XY0(CHIP8 *chip8, const CHIP8_INST *inst) { _VX = _VY; }
 
 /**
  * Set VX to VX OR VY
  */
-void opcode_8XY1(CHIP8 *chip8) { VX(_OPCODE) |= VY(_OPCODE); }
+void opcode_8XY1(CHIP8 *chip8, const CHIP8_INST *inst) { _VX |= _VY; }
 
 /**
  * Set VX to VX AND VY
  */
-void opcode_8XY2(CHIP8 *chip8) { VX(_OPCODE) &= VY(_OPCODE); }
+void opcode_8XY2(CHIP8 *chip8, const CHIP8_INST *inst) { _VX &= _VY; }
 
 /**
  * Set VX to VX XOR VY
  */
-void opcode_8XY3(CHIP8 *chip8) { VX(_OPCODE) ^= VY(_OPCODE); }
+void opcode_8XY3(CHIP8 *chip8, const CHIP8_INST *inst) { _VX ^= _VY; }
+
+/**
+ * Set VX to VX OR VY, the COSMAC VIP clears VF as a side effect
+ */
+void opcode_8XY1_VF(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX |= _VY;
+  _VF = 0;
+}
+
+/**
+ * Set VX to VX AND VY, the COSMAC VIP clears VF as a side effect
+ */
+void opcode_8XY2_VF(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX &= _VY;
+  _VF = 0;
+}
+
+/**
+ * Set VX to VX XOR VY, the COSMAC VIP clears VF as a side effect
+ */
+void opcode_8XY3_VF(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX ^= _VY;
+  _VF = 0;
+}
 
 /**
  * Add VY to VX; VF is set to 1 if there's a carry, else 0
  */
-void opcode_8XY4(CHIP8 *chip8) {
-  uint16_t add = (uint16_t)VX(_OPCODE) + (uint16_t)VY(_OPCODE);
-  VX(_OPCODE) = add & 0xFF;
+void opcode_8XY4(CHIP8 *chip8, const CHIP8_INST *inst) {
+  uint16_t add = (uint16_t)_VX + (uint16_t)_VY;
+  _VX = add & 0xFF;
   // set to 1 if there's a carry
   _VF = (add & 0x0100) >> 8;
 }
@@ -331,143 +1235,288 @@ void opcode_8XY4(CHIP8 *chip8) {
 /**
  * Subtract VY from VX; VF is set to 0 if there's a borrow, else 1
  */
-void opcode_8XY5(CHIP8 *chip8) {
-  if (VX(_OPCODE) > VY(_OPCODE)) {
+void opcode_8XY5(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX > _VY) {
     _VF = 1;
   } else {
     _VF = 0;
   }
-  VX(_OPCODE) -= VY(_OPCODE);
+  _VX -= _VY;
 }
 
 /**
  * Store the least significant bit of VX in VF and then shift VX to the right by
  * 1
  */
-void opcode_8XY6(CHIP8 *chip8) {
-  _VF = VX(_OPCODE) & 0x01;
-  VX(_OPCODE) >>= 1;
+void opcode_8XY6(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VF = _VX & 0x01;
+  _VX >>= 1;
+}
+
+/**
+ * Set VX to VY shifted right by 1 and VF to the bit shifted out, as the
+ * COSMAC VIP did
+ */
+void opcode_8XY6_VY(CHIP8 *chip8, const CHIP8_INST *inst) {
+  uint8_t bit = _VY & 0x01;
+  _VX = _VY >> 1;
+  _VF = bit;
 }
 
 /**
  * Set VX to VY minus VX; VF is set to 0 if there's a borrow, else 1
  */
-void opcode_8XY7(CHIP8 *chip8) {
-  if (VX(_OPCODE) < VY(_OPCODE)) {
+void opcode_8XY7(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX < _VY) {
     _VF = 1;
   } else {
     _VF = 0;
   }
-  VX(_OPCODE) = VY(_OPCODE) - VX(_OPCODE);
+  _VX = _VY - _VX;
 }
 
 /**
  * Store the most significant bit of VX in VF and then shift VX to the left by 1
  */
-void opcode_8XYE(CHIP8 *chip8) {
-  _VF = (VX(_OPCODE) * 0x80) >> 7;
-  VX(_OPCODE) <<= 1;
+void opcode_8XYE(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VF = (_VX * 0x80) >> 7;
+  _VX <<= 1;
+}
+
+/**
+ * Set VX to VY shifted left by 1 and VF to the bit shifted out, as the
+ * COSMAC VIP did
+ */
+void opcode_8XYE_VY(CHIP8 *chip8, const CHIP8_INST *inst) {
+  uint8_t bit = _VY >> 7;
+  _VX = _VY << 1;
+  _VF = bit;
 }
 
 /**
  * Skip next instruction if VX doesn't equal VY
  */
-void opcode_9XY0(CHIP8 *chip8) {
-  if (VX(_OPCODE) != VY(_OPCODE)) {
-    chip8->pc += 2;
+void opcode_9XY0(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX != _VY) {
+    SKIP_NEXT(chip8);
   }
 }
 
 /**
  * Set I to the address NNN
  */
-void opcode_ANNN(CHIP8 *chip8) {
-  chip8->index_reg = NNN(_OPCODE);
-  // printf("set I: %04X\n", NNN(_OPCODE));
+void opcode_ANNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->index_reg = _NNN;
+  // printf("set I: %04X\n", _NNN);
 }
 
 /**
  * Jump to the address NNN plus V0
  */
-void opcode_BNNN(CHIP8 *chip8) { chip8->pc = NNN(_OPCODE) + chip8->reg[0]; }
+void opcode_BNNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->pc = _NNN + chip8->reg[0];
+}
+
+/**
+ * Jump to the address XNN plus VX, SUPER-CHIP's reading of BNNN
+ */
+void opcode_BXNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->pc = _NNN + _VX;
+}
 
 /**
  * Set VX to the result of a bitwise AND operation on a random number and NN
  */
-void opcode_CXNN(CHIP8 *chip8) {
-  VX(_OPCODE) = NN(_OPCODE) & (uint8_t)(rand() % 256);
+void opcode_CXNN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX = _NN & chip8_random(chip8);
 }
 
+#if CHIP8_VARIANT == CHIP8_CLASSIC
 /**
- * Draw a sprite at coordinates VX, VY with a width of 8 pixels and a height of
- * N pixels
+ * XOR an 8 x N sprite into the display at VX, VY. Rows and bits past the
+ * edges are clipped, or wrap around to the other side. `wrap` is a constant
+ * in both callers, each gets its own copy of the loop.
  */
-void opcode_DXYN(CHIP8 *chip8) {
+static inline __attribute__((always_inline)) void draw_sprite(
+    CHIP8 *chip8, const CHIP8_INST *inst, int wrap) {
   chip8->reg[0xF] = 0;
-  int x = X(_OPCODE);
-  int y = Y(_OPCODE);
-  int n = N(_OPCODE);
-  // printf("draw(%d,%d,%d) %04X\n", chip8->reg[x] & (DISPLAY_WIDTH - 1),
-  //  chip8->reg[y] & (DISPLAY_HEIGHT - 1), n, chip8->index_reg);
   // The starting position of the sprite will wrap
-  byte start_x = chip8->reg[x] & (DISPLAY_WIDTH - 1);
-  byte start_y = chip8->reg[y] & (DISPLAY_HEIGHT - 1);
+  byte start_x = _VX & (DISPLAY_WIDTH - 1);
+  byte start_y = _VY & (DISPLAY_HEIGHT - 1);
   uint16_t index = chip8->index_reg;
-  for (byte height = 0; height < n; height++) {
-    for (byte width = 0; width < 8; width++) {
-      // draw every byte
-      byte pixel = (chip8->mem[index] & (0x80 >> width));
-      // clip sprite out of edge
-      byte cur_x = start_x + width;
-      byte cur_y = start_y + height;
-      if (cur_x >= DISPLAY_WIDTH || cur_y >= DISPLAY_HEIGHT) {
-        continue;
+  PROFILE_READ(index, _N);
+  for (byte height = 0; height < _N; height++) {
+    byte cur_y = start_y + height;
+    // clip sprite out of edge
+    if (cur_y >= DISPLAY_HEIGHT) {
+      if (!wrap) {
+        break;
+      }
+      cur_y &= DISPLAY_HEIGHT - 1;
+    }
+    // place the sprite byte at start_x, bits past the right edge fall off
+    uint64_t bits = (uint64_t)MEM_READ(chip8, index) << 56;
+    uint64_t row = bits >> start_x;
+    if (wrap) {
+      row |= bits << ((64 - start_x) & 63);
+    }
+    index++;
+    // VF is set to 1 if any screen pixels are flipped from set(white) to
+    // unset(black) when the sprite is drawn
+    if (chip8->display[cur_y] & row) {
+      chip8->reg[0xF] = 1;
+    }
+    // XOR
+    chip8->display[cur_y] ^= row;
+    if (row) {
+      chip8->display_refresh_flag = 1;
+    }
+  }
+}
+
+/**
+ * Draw a sprite at coordinates VX, VY with a width of 8 pixels and a height of
+ * N pixels
+ */
+void opcode_DXYN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  draw_sprite(chip8, inst, 0);
+}
+
+/**
+ * Draw a sprite at coordinates VX, VY with a width of 8 pixels and a height of
+ * N pixels, wrapping around the edges of the display
+ */
+void opcode_DXYN_WRAP(CHIP8 *chip8, const CHIP8_INST *inst) {
+  draw_sprite(chip8, inst, 1);
+}
+#else
+/**
+ * Spread every bit over two, lo-res pixels are two framebuffer pixels wide
+ */
+static uint32_t double_bits(uint32_t bits) {
+  bits = (bits | bits << 8) & 0x00FF00FF;
+  bits = (bits | bits << 4) & 0x0F0F0F0F;
+  bits = (bits | bits << 2) & 0x33333333;
+  bits = (bits | bits << 1) & 0x55555555;
+  return bits | bits << 1;
+}
+
+/**
+ * XOR a `width` x `height` sprite into every selected plane at VX, VY, each
+ * plane reading its own sprite data after the previous one. Every sprite row
+ * is blitted as one framebuffer word, doubled in both directions in lo-res.
+ * Rows and bits past the edges are clipped, or wrap around to the other side;
+ * `wrap` is a constant in every caller, each gets its own copy of the loop.
+ */
+static inline __attribute__((always_inline)) void draw_sprite(
+    CHIP8 *chip8, const CHIP8_INST *inst, int width, int height, int wrap) {
+  int scale = !chip8->hires;
+  int start_x = (_VX << scale) & (DISPLAY_WIDTH - 1);
+  int start_y = (_VY << scale) & (DISPLAY_HEIGHT - 1);
+  int bytes = width / 8;
+  uint16_t index = chip8->index_reg;
+  uint8_t collision = 0;
+  for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+    if (!(PLANE_MASK(chip8) & (1 << plane))) {
+      continue;
+    }
+    DISPLAY_ROW *display = chip8->display + plane * DISPLAY_HEIGHT;
+    PROFILE_READ(index, height * bytes);
+    for (int height_i = 0; height_i < height; height_i++, index += bytes) {
+      uint32_t bits = MEM_READ(chip8, index);
+      if (bytes == 2) {
+        bits = bits << 8 | MEM_READ(chip8, index + 1);
+      }
+      int pixels = width << scale;
+      if (scale) {
+        bits = double_bits(bits);
+      }
+      // bits past the right edge fall off
+      DISPLAY_ROW sprite = (DISPLAY_ROW)bits << (DISPLAY_WIDTH - pixels);
+      DISPLAY_ROW row = sprite >> start_x;
+      if (wrap) {
+        row |= sprite << ((DISPLAY_WIDTH - start_x) & (DISPLAY_WIDTH - 1));
       }
-      // VF is set to 1 if any screen pixels are flipped from set(white) to
-      // unset(black) when the sprite is drawn
-      // XOR
-      if (pixel) {
-        if (chip8->display[cur_y][cur_x] == DISPLAY_WHITE) {
-          chip8->reg[0xF] = 1;
-          chip8->display[cur_y][cur_x] = DISPLAY_BLACK;
-        } else {
-          chip8->display[cur_y][cur_x] = DISPLAY_WHITE;
+      for (int line = 0; line <= scale; line++) {
+        int cur_y = start_y + (height_i << scale) + line;
+        // clip sprite out of edge
+        if (cur_y >= DISPLAY_HEIGHT) {
+          if (!wrap) {
+            break;
+          }
+          cur_y &= DISPLAY_HEIGHT - 1;
         }
-        chip8->display_refresh_flag = 1;
+        collision |= (display[cur_y] & row) != 0;
+        display[cur_y] ^= row;
       }
     }
-    index++;
   }
+  _VF = collision;
+  chip8->display_refresh_flag = 1;
+}
+
+/**
+ * Draw a sprite at coordinates VX, VY with a width of 8 pixels and a height of
+ * N pixels
+ */
+void opcode_DXYN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  draw_sprite(chip8, inst, 8, _N, 0);
+}
+
+/**
+ * Draw a sprite at coordinates VX, VY with a width of 8 pixels and a height of
+ * N pixels, wrapping around the edges of the display
+ */
+void opcode_DXYN_WRAP(CHIP8 *chip8, const CHIP8_INST *inst) {
+  draw_sprite(chip8, inst, 8, _N, 1);
+}
+
+/**
+ * Draw a 16x16 sprite at coordinates VX, VY
+ */
+void opcode_DXY0(CHIP8 *chip8, const CHIP8_INST *inst) {
+  draw_sprite(chip8, inst, 16, 16, 0);
 }
 
+/**
+ * Draw a 16x16 sprite at coordinates VX, VY, wrapping around the edges of the
+ * display
+ */
+void opcode_DXY0_WRAP(CHIP8 *chip8, const CHIP8_INST *inst) {
+  draw_sprite(chip8, inst, 16, 16, 1);
+}
+#endif
+
 /**
  * Skip next instruction if the key stored in VX is pressed
  */
-void opcode_EX9E(CHIP8 *chip8) {
-  if (VX(_OPCODE) >= 16) {
+void opcode_EX9E(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX >= 16) {
     return;
   }
-  if (chip8->keys[VX(_OPCODE)]) {
-    chip8->pc += 2;
+  if (chip8->keys[_VX]) {
+    SKIP_NEXT(chip8);
   }
 }
 
 /**
  * Skip next instruction if the key stored in VX isn't pressed
  */
-void opcode_EXA1(CHIP8 *chip8) {
-  if (VX(_OPCODE) >= 16) {
+void opcode_EXA1(CHIP8 *chip8, const CHIP8_INST *inst) {
+  if (_VX >= 16) {
     return;
   }
-  if (!(chip8->keys[VX(_OPCODE)])) {
-    chip8->pc += 2;
+  if (!(chip8->keys[_VX])) {
+    SKIP_NEXT(chip8);
   }
 }
 
 /**
  * Set VX to the value of the delay timer
  */
-void opcode_FX07(CHIP8 *chip8) { VX(_OPCODE) = chip8->delay_timer; }
+void opcode_FX07(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _VX = chip8->delay_timer;
+}
 
 /**
  * Block instruction
@@ -475,12 +1524,12 @@ void opcode_FX07(CHIP8 *chip8) { VX(_OPCODE) = chip8->delay_timer; }
  * Wait for a key press and store the key in VX
  * Timers continues counting
  */
-void opcode_FX0A(CHIP8 *chip8) {
+void opcode_FX0A(CHIP8 *chip8, const CHIP8_INST *inst) {
   byte key_pressed = 0;
   for (byte i = 0; i < 0xF; i++) {
     if (chip8->keys[i]) {
       key_pressed = 1;
-      VX(_OPCODE) = i;
+      _VX = i;
     }
   }
   if (!key_pressed) {
@@ -492,54 +1541,237 @@ void opcode_FX0A(CHIP8 *chip8) {
 /**
  * Set the delay timer to the value in VX
  */
-void opcode_FX15(CHIP8 *chip8) { chip8->delay_timer = VX(_OPCODE); }
+void opcode_FX15(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->delay_timer = _VX;
+}
 
 /**
  * Set the sound timer to the value in VX
  */
-void opcode_FX18(CHIP8 *chip8) { chip8->sound_timer = VX(_OPCODE); }
+void opcode_FX18(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->sound_timer = _VX;
+}
 
 /**
  * Add the value stored in VX to I;
  */
-void opcode_FX1E(CHIP8 *chip8) { _I += VX(_OPCODE); }
+void opcode_FX1E(CHIP8 *chip8, const CHIP8_INST *inst) { _I += _VX; }
 
 /**
  * Set I to the location of the sprite for the character in VX
  * Characters 0-F (in hexadecimal) are represented by a 8x5 font.
  */
-void opcode_FX29(CHIP8 *chip8) {
-  _I = chip8->mem[FONTSET_MEM_START + 5 * VX(_OPCODE)];
+void opcode_FX29(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _I = MEM_READ(chip8, FONTSET_MEM_START + 5 * _VX);
 }
 
 /**
  * Store the binary-coded decimal representation of VX at address I, I+1, and
  * I+2
  */
-void opcode_FX33(CHIP8 *chip8) {
-  int x = VX(_OPCODE);
+void opcode_FX33(CHIP8 *chip8, const CHIP8_INST *inst) {
+  int x = _VX;
   byte one = x % 10u;
   byte ten = x / 10u % 10u;
   byte hund = x / 100u % 10u;
-  chip8->mem[_I] = one;
-  chip8->mem[_I + 1] = ten;
-  chip8->mem[_I + 2] = hund;
+  const uint8_t bcd[3] = {one, ten, hund};
+  chip8_write(chip8, _I, bcd, 3);
+  PROFILE_WRITE(_I, 3);
 }
 
 /**
  * Store V0 to VX (inclusive) in memory starting at address I
  */
-void opcode_FX55(CHIP8 *chip8) {
-  for (int i = 0; i <= X(_OPCODE); i++) {
-    chip8->mem[_I + i] = chip8->reg[i];
-  }
+void opcode_FX55(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8_write(chip8, _I, chip8->reg, _X + 1);
+  PROFILE_WRITE(_I, _X + 1);
 }
 
 /**
  * Fill V0 to VX (inclusive) with values from memory starting at address I
  */
-void opcode_FX65(CHIP8 *chip8) {
-  for (int i = 0; i <= X(_OPCODE); i++) {
-    chip8->reg[i] = chip8->mem[_I + i];
+void opcode_FX65(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8_read(chip8, _I, chip8->reg, _X + 1);
+  PROFILE_READ(_I, _X + 1);
+}
+
+/**
+ * Store V0 to VX (inclusive) in memory starting at address I, leaving I past
+ * the last byte stored
+ */
+void opcode_FX55_I(CHIP8 *chip8, const CHIP8_INST *inst) {
+  opcode_FX55(chip8, inst);
+  _I += _X + 1;
+}
+
+/**
+ * Fill V0 to VX (inclusive) from memory starting at address I, leaving I past
+ * the last byte loaded
+ */
+void opcode_FX65_I(CHIP8 *chip8, const CHIP8_INST *inst) {
+  opcode_FX65(chip8, inst);
+  _I += _X + 1;
+}
+
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+/**
+ * Move the selected planes `down` rows down and `right` pixels right,
+ * negative amounts move up and left. Pixels shifted in are cleared.
+ */
+static void scroll(CHIP8 *chip8, int down, int right) {
+  for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+    if (!(PLANE_MASK(chip8) & (1 << plane))) {
+      continue;
+    }
+    DISPLAY_ROW *display = chip8->display + plane * DISPLAY_HEIGHT;
+    if (down > 0) {
+      memmove(display + down, display,
+              (DISPLAY_HEIGHT - down) * sizeof(DISPLAY_ROW));
+      memset(display, 0, down * sizeof(DISPLAY_ROW));
+    } else if (down < 0) {
+      memmove(display, display - down,
+              (DISPLAY_HEIGHT + down) * sizeof(DISPLAY_ROW));
+      memset(display + DISPLAY_HEIGHT + down, 0, -down * sizeof(DISPLAY_ROW));
+    }
+    // a horizontal scroll is one shift per row
+    for (int y = 0; right && y < DISPLAY_HEIGHT; y++) {
+      if (right > 0) {
+        display[y] >>= right;
+      } else {
+        display[y] <<= -right;
+      }
+    }
+  }
+  chip8->display_refresh_flag = 1;
+}
+
+/**
+ * Scroll the display down by N pixels
+ */
+void opcode_00CN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  scroll(chip8, _N << !chip8->hires, 0);
+}
+
+/**
+ * Scroll the display right by 4 pixels
+ */
+void opcode_00FB(CHIP8 *chip8, const CHIP8_INST *inst) {
+  scroll(chip8, 0, 4 << !chip8->hires);
+}
+
+/**
+ * Scroll the display left by 4 pixels
+ */
+void opcode_00FC(CHIP8 *chip8, const CHIP8_INST *inst) {
+  scroll(chip8, 0, -(4 << !chip8->hires));
+}
+
+/**
+ * Exit the interpreter
+ */
+void opcode_00FD(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->state = SYS_QUIT;
+}
+
+/**
+ * Switch to low resolution (64x32), clears the display
+ */
+void opcode_00FE(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->hires = 0;
+  memset(chip8->display, 0, sizeof(chip8->display));
+  chip8->display_refresh_flag = 1;
+}
+
+/**
+ * Switch to high resolution (128x64), clears the display
+ */
+void opcode_00FF(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->hires = 1;
+  memset(chip8->display, 0, sizeof(chip8->display));
+  chip8->display_refresh_flag = 1;
+}
+
+/**
+ * Set I to the location of the big sprite for the digit in VX
+ */
+void opcode_FX30(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _I = BIG_FONTSET_MEM_START + 10 * (_VX & 0xF);
+}
+
+/**
+ * Store V0 to VX (inclusive) in the user flags
+ */
+void opcode_FX75(CHIP8 *chip8, const CHIP8_INST *inst) {
+  memcpy(chip8->flags, chip8->reg, _X + 1);
+}
+
+/**
+ * Fill V0 to VX (inclusive) from the user flags
+ */
+void opcode_FX85(CHIP8 *chip8, const CHIP8_INST *inst) {
+  memcpy(chip8->reg, chip8->flags, _X + 1);
+}
+#endif
+
+#if CHIP8_VARIANT == CHIP8_XO
+/**
+ * Scroll the display up by N pixels
+ */
+void opcode_00DN(CHIP8 *chip8, const CHIP8_INST *inst) {
+  scroll(chip8, -(_N << !chip8->hires), 0);
+}
+
+/**
+ * Store VX to VY (inclusive, in either order) in memory starting at address I
+ */
+void opcode_5XY2(CHIP8 *chip8, const CHIP8_INST *inst) {
+  int step = _X <= _Y ? 1 : -1;
+  int count = (_Y - _X) * step + 1;
+  uint8_t bytes[16];
+  for (int i = 0; i < count; i++) {
+    bytes[i] = chip8->reg[_X + i * step];
+  }
+  chip8_write(chip8, _I, bytes, count);
+  PROFILE_WRITE(_I, count);
+}
+
+/**
+ * Fill VX to VY (inclusive, in either order) from memory starting at address I
+ */
+void opcode_5XY3(CHIP8 *chip8, const CHIP8_INST *inst) {
+  int step = _X <= _Y ? 1 : -1;
+  int count = (_Y - _X) * step + 1;
+  for (int i = 0; i < count; i++) {
+    chip8->reg[_X + i * step] = MEM_READ(chip8, _I + i);
   }
+  PROFILE_READ(_I, count);
 }
+
+/**
+ * Set I to the 16-bit address in the next instruction word
+ */
+void opcode_F000(CHIP8 *chip8, const CHIP8_INST *inst) {
+  _I = fetch(chip8, chip8->pc);
+  chip8->pc += 2;
+}
+
+/**
+ * Select the planes drawn to with the bit mask N
+ */
+void opcode_FN01(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8->planes = _X & ((1 << DISPLAY_PLANES) - 1);
+}
+
+/**
+ * Load the 16-byte audio pattern from memory starting at address I
+ */
+void opcode_F002(CHIP8 *chip8, const CHIP8_INST *inst) {
+  chip8_read(chip8, _I, chip8->pattern, 16);
+  PROFILE_READ(_I, 16);
+}
+
+/**
+ * Set the audio pattern playback rate to VX
+ */
+void opcode_FX3A(CHIP8 *chip8, const CHIP8_INST *inst) { chip8->pitch = _VX; }
+#endif
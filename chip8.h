@@ -1,6 +1,7 @@
 #ifndef __CHIP8_H__
 #define __CHIP8_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,50 +13,268 @@
 #define CYCLE_DELAY(X) (1000000 / (X))
 // delay around 16666 microseconds to decrease timer
 #define TIMER_DELAY (1000000 / 60)
+// COSMAC VIP machine cycles (8 clocks of its 1.76 MHz CDP1802) in a 60 Hz
+// frame, less the 1024 the display DMA takes: the interpreter's share
+#define VIP_FRAME_CYCLES (3668 - 1024)
 
+// machine variants, picked at compile time with -DCHIP8_VARIANT=...
+#define CHIP8_CLASSIC 0
+// SUPER-CHIP: 128x64 hi-res mode, scrolling, 16x16 sprites, big font
+#define CHIP8_SCHIP 1
+// XO-CHIP: SUPER-CHIP plus 64 KB memory, two bit planes and audio patterns
+#define CHIP8_XO 2
+#ifndef CHIP8_VARIANT
+#define CHIP8_VARIANT CHIP8_CLASSIC
+#endif
+
+#if CHIP8_VARIANT == CHIP8_CLASSIC
 #define MEM_SIZE 4096
-#define MEM_START 0x200
 #define DISPLAY_HEIGHT 32
 #define DISPLAY_WIDTH 64
+#define DISPLAY_PLANES 1
+typedef uint64_t DISPLAY_ROW;
+#else
+#if CHIP8_VARIANT == CHIP8_XO
+#define MEM_SIZE 65536
+#define DISPLAY_PLANES 2
+#else
+#define MEM_SIZE 4096
+#define DISPLAY_PLANES 1
+#endif
+// the framebuffer is always hi-res, lo-res pixels are drawn as 2x2 blocks
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_WIDTH 128
+typedef unsigned __int128 DISPLAY_ROW;
+#endif
+#define MEM_START 0x200
 #define KEY_SIZE 16
+// framebuffer packed 8 pixels to the byte, see chip8_display_bytes()
+#define DISPLAY_BYTES (DISPLAY_PLANES * DISPLAY_HEIGHT * (DISPLAY_WIDTH / 8))
 #define DISPLAY_WHITE 0xFFFFFFFF
 #define DISPLAY_BLACK 0x00000000
+// RGBA of every DISPLAY_COLOR() value: background, plane 1, plane 2, both
+#define DISPLAY_PALETTE \
+  { DISPLAY_BLACK, DISPLAY_WHITE, 0xAAAAAAFF, 0x555555FF }
+// pixel (x, y) of the bit-packed framebuffer, 1 for white
+#define DISPLAY_PIXEL(display, x, y) \
+  ((uint8_t)(((display)[y] >> (DISPLAY_WIDTH - 1 - (x))) & 1))
+// color index of pixel (x, y), one bit per plane
+#if DISPLAY_PLANES == 1
+#define DISPLAY_COLOR(display, x, y) DISPLAY_PIXEL(display, x, y)
+#else
+#define DISPLAY_COLOR(display, x, y) \
+  (DISPLAY_PIXEL(display, x, y) |    \
+   DISPLAY_PIXEL((display) + DISPLAY_HEIGHT, x, y) << 1)
+#endif
 
 #define FONTSET_SIZE 80
 #define FONTSET_MEM_START 0x50
 extern uint8_t chip8_fontset[];
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+// 8x10 digits for FX30, right after the small font
+#define BIG_FONTSET_SIZE 160
+#define BIG_FONTSET_MEM_START (FONTSET_MEM_START + FONTSET_SIZE)
+extern uint8_t chip8_big_fontset[];
+#endif
 
 typedef uint8_t byte;
 
+// behaviors the CHIP-8 interpreters disagree on, a bit mask picked per ROM.
+// With none set the core shifts VX in place, FX55/FX65 leave I alone, BNNN
+// adds V0 and sprites clip at the edges. Quirks are resolved when an opcode
+// is decoded, each one selects its own handler. QUIRK_VIP_CLOCK changes no
+// handler but how the frontends split a run into frames, see chip8_run_vip().
+#define QUIRK_SHIFT_VY 0x01  // 8XY6/8XYE shift VY into VX (COSMAC VIP)
+#define QUIRK_MEMORY_I 0x02  // FX55/FX65 leave I past the last register
+#define QUIRK_JUMP_VX 0x04   // BXNN jumps to XNN + VX (SUPER-CHIP)
+#define QUIRK_WRAP 0x08      // sprites wrap around the edges (XO-CHIP)
+#define QUIRK_VF_RESET 0x10  // 8XY1/8XY2/8XY3 clear VF (COSMAC VIP)
+#define QUIRK_VIP_CLOCK 0x20  // COSMAC VIP instruction timing, DXYN waits
+                              // for the vertical blank
+#define QUIRK_COUNT 6
+#define QUIRKS_ALL ((1u << QUIRK_COUNT) - 1)
+// profiles of the original interpreters
+#define QUIRKS_VIP \
+  (QUIRK_SHIFT_VY | QUIRK_MEMORY_I | QUIRK_VF_RESET | QUIRK_VIP_CLOCK)
+#define QUIRKS_SCHIP QUIRK_JUMP_VX
+#define QUIRKS_XO (QUIRK_SHIFT_VY | QUIRK_MEMORY_I | QUIRK_WRAP)
+
 enum sys_state { SYS_QUIT, SYS_RUNNING, SYS_PAUSE };
 
-typedef struct chip8 {
+// loops a program can spin in without changing state, see chip8_idle()
+enum chip8_idle {
+  IDLE_NONE,
+  IDLE_DELAY,  // FX07/3X00/1NNN polling a running delay timer
+  IDLE_KEY,    // FX0A with no key pressed
+  IDLE_HALT,   // 1NNN jumping to itself
+};
+
+typedef struct chip8 CHIP8;
+typedef struct chip8_inst CHIP8_INST;
+typedef void (*opcode_func)(CHIP8 *chip, const CHIP8_INST *inst);
+
+// an instruction decoded once: handler plus the operands it needs
+struct chip8_inst {
+  opcode_func func;
+  uint16_t opcode;
+  uint16_t nnn;
+  uint8_t x;
+  uint8_t y;
+  uint8_t n;
+  uint8_t nn;
+};
+
+// memory is shared with an image in pages until an instance writes to them
+#define MEM_PAGE_SIZE 256
+#define MEM_PAGES (MEM_SIZE / MEM_PAGE_SIZE)
+
+/**
+ * Read-only memory image: the fonts and a ROM with every address already
+ * decoded for one set of quirks. Any number of instances can run from one
+ * image, each page of it stays shared until an instance writes to the page and
+ * gets a private copy. The image must outlive the instances created from it.
+ */
+typedef struct chip8_image {
+  uint32_t quirks;  // QUIRK_* flags of the instances running from the image
+  // memory page by page, in `mem` or, for an image from chip8_image_map(),
+  // the whole pages of the ROM right in the caller's bytes
+  const uint8_t *pages[MEM_PAGES];
   uint8_t mem[MEM_SIZE];
-  uint8_t reg[16];
+  CHIP8_INST decoded[MEM_SIZE];
+} CHIP8_IMAGE;
+
+struct chip8 {
+  // registers touched by nearly every instruction, one cache line
+  _Alignas(64) uint8_t reg[16];
   uint16_t index_reg;
   uint16_t pc;      // keep trace of opcode address
   uint16_t opcode;  // keep trace of opcode
-  uint16_t stack[16];
-  uint8_t sp;  // keep trace of stack top
+  uint8_t sp;       // keep trace of stack top
   uint8_t delay_timer;
   uint8_t sound_timer;
-  // 32-bit pixel format can store RGB color information and an 8-bit
-  // transparency channel (alpha channel)
-  uint32_t display[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+  uint16_t vip_clock;  // VIP machine cycles spent in the frame, see
+                       // chip8_run_vip()
+  uint32_t rng;  // xorshift32 state for CXNN, see chip8_seed()
+  uint16_t stack[16];
+
+  // one bit per pixel, one word per row, the top bit is the leftmost pixel.
+  // With several planes, plane p starts at row p * DISPLAY_HEIGHT.
+  // chip8_display_rgba() expands rows to 32-bit RGBA when they are presented
+  DISPLAY_ROW display[DISPLAY_PLANES * DISPLAY_HEIGHT];
   uint8_t keys[16];  // pressed or not
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+  uint8_t hires;      // 00FF high resolution mode, 00FE back to low
+  uint8_t flags[16];  // FX75/FX85 user flags
+#endif
+#if CHIP8_VARIANT == CHIP8_XO
+  uint8_t planes;       // FN01 planes drawn, scrolled and cleared, a bit mask
+  uint8_t pitch;        // FX3A audio pattern playback rate
+  uint8_t pattern[16];  // F002 1-bit audio pattern
+#endif
+  // everything above is the machine state captured by savestates, along with
+  // the contents of memory. savestate.c asserts the offset of every field:
+  // adding, moving or resizing one must bump SAVESTATE_VERSION
 
-  uint8_t display_refresh_flag;
+  uint8_t display_refresh_flag;  // set when the display changes, cleared by
+                                 // the frontend after presenting
   enum sys_state state;
-} CHIP8;
+
+  const CHIP8_IMAGE *image;
+  // pages written since they were taken from the image, bit p % 32 of word
+  // p / 32; only those are private to the instance
+  uint32_t dirty[(MEM_PAGES + 31) / 32];
+  // memory, page by page, read with MEM_READ() or chip8_read() and written
+  // with chip8_write()
+  uint8_t *pages[MEM_PAGES];
+  // predecoded instruction at every (even and odd) address, page by page.
+  // Entries of private pages are reset to a decoding stub whenever the two
+  // bytes behind them are written, image pages are decoded in advance
+  CHIP8_INST *decoded_pages[MEM_PAGES];
+};
+
+// size of the machine state at the start of CHIP8
+#define CHIP8_STATE_SIZE offsetof(CHIP8, display_refresh_flag)
+
+// byte of memory at `addr`, wrapped to MEM_SIZE
+#define MEM_READ(chip8, addr)                                  \
+  ((chip8)->pages[((addr) & (MEM_SIZE - 1)) / MEM_PAGE_SIZE] \
+                 [(addr) % MEM_PAGE_SIZE])
+// decoded instruction at `addr`, wrapped to MEM_SIZE
+#define DECODED(chip8, addr)                                            \
+  (&(chip8)->decoded_pages[((addr) & (MEM_SIZE - 1)) / MEM_PAGE_SIZE] \
+                          [(addr) % MEM_PAGE_SIZE])
+// page written by the instance, so no longer the image's
+#define PAGE_DIRTY(chip8, page) \
+  (((chip8)->dirty[(page) / 32] >> ((page) % 32)) & 1)
+
+CHIP8_IMAGE *chip8_image_new(const uint8_t *rom, size_t size,
+                             uint32_t quirks);
+
+CHIP8_IMAGE *chip8_image_map(const uint8_t *rom, size_t size,
+                             uint32_t quirks);
+
+void chip8_image_free(CHIP8_IMAGE *image);
+
+CHIP8 *chip8_init_image(const CHIP8_IMAGE *image);
+
+void chip8_free(CHIP8 *chip8);
+
+void chip8_read(const CHIP8 *chip8, uint16_t addr, uint8_t *bytes,
+                uint32_t len);
+
+void chip8_write(CHIP8 *chip8, uint16_t addr, const uint8_t *bytes,
+                 uint32_t len);
+
+void chip8_share_page(CHIP8 *chip8, int page);
 
 CHIP8 *chip8_init();
 
+CHIP8 *chip8_init_quirks(uint32_t quirks);
+
+uint8_t chip8_parse_quirks(const char *text, uint32_t *quirks);
+
 uint8_t chip8_load_rom(CHIP8 *chip8, const char *rom_name);
 
+uint8_t chip8_load_bytes(CHIP8 *chip8, const uint8_t *rom, size_t size);
+
+void chip8_seed(CHIP8 *chip8, uint32_t seed);
+
+uint16_t chip8_key_mask(CHIP8 *chip8);
+
+void chip8_set_keys(CHIP8 *chip8, uint16_t mask);
+
 void chip8_cycle(CHIP8 *chip8);
 
+void chip8_run(CHIP8 *chip8, uint32_t cycles);
+
+uint32_t chip8_run_vip(CHIP8 *chip8, uint32_t cycles);
+
+enum chip8_idle chip8_idle(CHIP8 *chip8);
+
+uint32_t chip8_skip_idle(CHIP8 *chip8, uint32_t cycles);
+
 void chip8_timer(CHIP8 *chip8);
 
+void chip8_display_rgba(const DISPLAY_ROW *display, int rows,
+                        uint32_t rgba[][DISPLAY_WIDTH]);
+
+void chip8_display_bytes(const DISPLAY_ROW *display, uint8_t *bytes);
+
+void chip8_decode(uint16_t opcode, uint32_t quirks, CHIP8_INST *inst);
+
+// every handler with the name of the instruction it implements
+typedef struct chip8_handler {
+  opcode_func func;
+  const char *name;
+} CHIP8_HANDLER;
+
+extern const CHIP8_HANDLER chip8_handlers[];
+extern const size_t chip8_handler_count;
+
+const char *chip8_handler_name(opcode_func func);
+
+void chip8_invalidate(CHIP8 *chip8, uint16_t addr, uint32_t len);
+
 #define _OPCODE (chip8->opcode)
 #define X(opcode) (uint8_t)((0x0F00 & (opcode)) >> 8)
 #define Y(opcode) (uint8_t)((0x00F0 & (opcode)) >> 4)
@@ -68,56 +287,151 @@ void chip8_timer(CHIP8 *chip8);
 #define _VF (chip8->reg[0xF])
 #define _I (chip8->index_reg)
 
-typedef void (*opcode_func)(CHIP8 *chip);
+// operands of the predecoded instruction being executed
+#define _INST (inst)
+#define _X (_INST->x)
+#define _Y (_INST->y)
+#define _N (_INST->n)
+#define _NN (_INST->nn)
+#define _NNN (_INST->nnn)
+#define _VX (chip8->reg[_INST->x])
+#define _VY (chip8->reg[_INST->y])
+
 #define OPCODE(N) opcode_##N(chip8)
 
-void opcode_00E0(CHIP8 *chip);  // Clear the screen
-void opcode_00EE(CHIP8 *chip);  // Return from a subroutine
-void opcode_1NNN(CHIP8 *chip);  // Jump to address NNN
-void opcode_2NNN(CHIP8 *chip);  // Call subroutine at NNN
-void opcode_3XNN(CHIP8 *chip);  // Skip next instruction if VX equals NN
-void opcode_4XNN(CHIP8 *chip);  // Skip next instruction if VX doesn't equal NN
-void opcode_5XY0(CHIP8 *chip);  // Skip next instruction if VX equals VY
-void opcode_6XNN(CHIP8 *chip);  // Set VX to NN
-void opcode_7XNN(CHIP8 *chip);  // Add NN to VX
-void opcode_8XY0(CHIP8 *chip);  // Set VX to the value of VY
-void opcode_8XY1(CHIP8 *chip);  // Set VX to VX OR VY
-void opcode_8XY2(CHIP8 *chip);  // Set VX to VX AND VY
-void opcode_8XY3(CHIP8 *chip);  // Set VX to VX XOR VY
-void opcode_8XY4(
-    CHIP8 *chip);  // Add VY to VX; VF is set to 1 if there's a carry, else 0
-void opcode_8XY5(CHIP8 *chip);  // Subtract VY from VX; VF is set to 0 if
-                                // there's a borrow, else 1
-void opcode_8XY6(CHIP8 *chip);  // Store the least significant bit of VX in VF
-                                // and then shift VX to the right by 1
-void opcode_8XY7(CHIP8 *chip);  // Set VX to VY minus VX; VF is set to 0 if
-                                // there's a borrow, else 1
-void opcode_8XYE(CHIP8 *chip);  // Store the most significant bit of VX in VF
-                                // and then shift VX to the left by 1
-void opcode_9XY0(CHIP8 *chip);  // Skip next instruction if VX doesn't equal VY
-void opcode_ANNN(CHIP8 *chip);  // Set I to the address NNN
-void opcode_BNNN(CHIP8 *chip);  // Jump to the address NNN plus V0
-void opcode_CXNN(CHIP8 *chip);  // Set VX to the result of a bitwise AND
-                                // operation on a random number and NN
-void opcode_DXYN(CHIP8 *chip);  // Draw a sprite at coordinates VX, VY with a
-                                // width of 8 pixels and a height of N pixels
-void opcode_EX9E(
-    CHIP8 *chip);  // Skip next instruction if the key stored in VX is pressed
-void opcode_EXA1(CHIP8 *chip);  // Skip next instruction if the key stored in VX
-                                // isn't pressed
-void opcode_FX07(CHIP8 *chip);  // Set VX to the value of the delay timer
-void opcode_FX0A(CHIP8 *chip);  // Wait for a key press and store the key in VX
-void opcode_FX15(CHIP8 *chip);  // Set the delay timer to the value in VX
-void opcode_FX18(CHIP8 *chip);  // Set the sound timer to the value in VX
-void opcode_FX1E(CHIP8 *chip);  // Add the value stored in VX to I; VF is set to
-                                // 1 if there's a range overflow, else 0
-void opcode_FX29(CHIP8 *chip);  // Set I to the location of the sprite for the
-                                // character in VX
-void opcode_FX33(CHIP8 *chip);  // Store the binary-coded decimal representation
-                                // of VX at address I, I+1, and I+2
-void opcode_FX55(
-    CHIP8 *chip);  // Store V0 to VX (inclusive) in memory starting at address I
-void opcode_FX65(CHIP8 *chip);  // Fill V0 to VX (inclusive) with values from
-                                // memory starting at address I
+// Clear the screen
+void opcode_00E0(CHIP8 *chip, const CHIP8_INST *inst);
+// Return from a subroutine
+void opcode_00EE(CHIP8 *chip, const CHIP8_INST *inst);
+// Jump to address NNN
+void opcode_1NNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Call subroutine at NNN
+void opcode_2NNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Skip next instruction if VX equals NN
+void opcode_3XNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Skip next instruction if VX doesn't equal NN
+void opcode_4XNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Skip next instruction if VX equals VY
+void opcode_5XY0(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to NN
+void opcode_6XNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Add NN to VX
+void opcode_7XNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to the value of VY
+void opcode_8XY0(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VX OR VY
+void opcode_8XY1(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VX AND VY
+void opcode_8XY2(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VX XOR VY
+void opcode_8XY3(CHIP8 *chip, const CHIP8_INST *inst);
+// Add VY to VX; VF is set to 1 if there's a carry, else 0
+void opcode_8XY4(CHIP8 *chip, const CHIP8_INST *inst);
+// Subtract VY from VX; VF is set to 0 if there's a borrow, else 1
+void opcode_8XY5(CHIP8 *chip, const CHIP8_INST *inst);
+// Store the least significant bit of VX in VF and then shift VX to the right by
+// 1
+void opcode_8XY6(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VY minus VX; VF is set to 0 if there's a borrow, else 1
+void opcode_8XY7(CHIP8 *chip, const CHIP8_INST *inst);
+// Store the most significant bit of VX in VF and then shift VX to the left by 1
+void opcode_8XYE(CHIP8 *chip, const CHIP8_INST *inst);
+// Skip next instruction if VX doesn't equal VY
+void opcode_9XY0(CHIP8 *chip, const CHIP8_INST *inst);
+// Set I to the address NNN
+void opcode_ANNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Jump to the address NNN plus V0
+void opcode_BNNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to the result of a bitwise AND operation on a random number and NN
+void opcode_CXNN(CHIP8 *chip, const CHIP8_INST *inst);
+// Draw a sprite at coordinates VX, VY with a width of 8 pixels and a height of
+// N pixels
+void opcode_DXYN(CHIP8 *chip, const CHIP8_INST *inst);
+// Skip next instruction if the key stored in VX is pressed
+void opcode_EX9E(CHIP8 *chip, const CHIP8_INST *inst);
+// Skip next instruction if the key stored in VX isn't pressed
+void opcode_EXA1(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to the value of the delay timer
+void opcode_FX07(CHIP8 *chip, const CHIP8_INST *inst);
+// Wait for a key press and store the key in VX
+void opcode_FX0A(CHIP8 *chip, const CHIP8_INST *inst);
+// Set the delay timer to the value in VX
+void opcode_FX15(CHIP8 *chip, const CHIP8_INST *inst);
+// Set the sound timer to the value in VX
+void opcode_FX18(CHIP8 *chip, const CHIP8_INST *inst);
+// Add the value stored in VX to I; VF is set to 1 if there's a range overflow,
+// else 0
+void opcode_FX1E(CHIP8 *chip, const CHIP8_INST *inst);
+// Set I to the location of the sprite for the character in VX
+void opcode_FX29(CHIP8 *chip, const CHIP8_INST *inst);
+// Store the binary-coded decimal representation of VX at address I, I+1, and
+// I+2
+void opcode_FX33(CHIP8 *chip, const CHIP8_INST *inst);
+// Store V0 to VX (inclusive) in memory starting at address I
+void opcode_FX55(CHIP8 *chip, const CHIP8_INST *inst);
+// Fill V0 to VX (inclusive) with values from memory starting at address I
+void opcode_FX65(CHIP8 *chip, const CHIP8_INST *inst);
+
+// quirk variants of the handlers above
+// Set VX to VX OR VY and clear VF
+void opcode_8XY1_VF(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VX AND VY and clear VF
+void opcode_8XY2_VF(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VX XOR VY and clear VF
+void opcode_8XY3_VF(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VY shifted right by 1, VF to the bit shifted out
+void opcode_8XY6_VY(CHIP8 *chip, const CHIP8_INST *inst);
+// Set VX to VY shifted left by 1, VF to the bit shifted out
+void opcode_8XYE_VY(CHIP8 *chip, const CHIP8_INST *inst);
+// Jump to the address XNN plus VX
+void opcode_BXNN(CHIP8 *chip, const CHIP8_INST *inst);
+// DXYN with the sprite wrapping around the edges of the display
+void opcode_DXYN_WRAP(CHIP8 *chip, const CHIP8_INST *inst);
+// FX55, then advance I past the last register stored
+void opcode_FX55_I(CHIP8 *chip, const CHIP8_INST *inst);
+// FX65, then advance I past the last register loaded
+void opcode_FX65_I(CHIP8 *chip, const CHIP8_INST *inst);
+
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+// Scroll the display down by N pixels
+void opcode_00CN(CHIP8 *chip, const CHIP8_INST *inst);
+// Scroll the display right by 4 pixels
+void opcode_00FB(CHIP8 *chip, const CHIP8_INST *inst);
+// Scroll the display left by 4 pixels
+void opcode_00FC(CHIP8 *chip, const CHIP8_INST *inst);
+// Exit the interpreter
+void opcode_00FD(CHIP8 *chip, const CHIP8_INST *inst);
+// Switch to low resolution (64x32)
+void opcode_00FE(CHIP8 *chip, const CHIP8_INST *inst);
+// Switch to high resolution (128x64)
+void opcode_00FF(CHIP8 *chip, const CHIP8_INST *inst);
+// Draw a 16x16 sprite at coordinates VX, VY
+void opcode_DXY0(CHIP8 *chip, const CHIP8_INST *inst);
+// DXY0 with the sprite wrapping around the edges of the display
+void opcode_DXY0_WRAP(CHIP8 *chip, const CHIP8_INST *inst);
+// Set I to the location of the big sprite for the digit in VX
+void opcode_FX30(CHIP8 *chip, const CHIP8_INST *inst);
+// Store V0 to VX (inclusive) in the user flags
+void opcode_FX75(CHIP8 *chip, const CHIP8_INST *inst);
+// Fill V0 to VX (inclusive) from the user flags
+void opcode_FX85(CHIP8 *chip, const CHIP8_INST *inst);
+#endif
+
+#if CHIP8_VARIANT == CHIP8_XO
+// Scroll the display up by N pixels
+void opcode_00DN(CHIP8 *chip, const CHIP8_INST *inst);
+// Store VX to VY (inclusive, in either order) in memory starting at address I
+void opcode_5XY2(CHIP8 *chip, const CHIP8_INST *inst);
+// Fill VX to VY (inclusive, in either order) from memory starting at address I
+void opcode_5XY3(CHIP8 *chip, const CHIP8_INST *inst);
+// Set I to the 16-bit address in the next instruction word
+void opcode_F000(CHIP8 *chip, const CHIP8_INST *inst);
+// Select the planes drawn to with the bit mask N
+void opcode_FN01(CHIP8 *chip, const CHIP8_INST *inst);
+// Load the 16-byte audio pattern from memory starting at address I
+void opcode_F002(CHIP8 *chip, const CHIP8_INST *inst);
+// Set the audio pattern playback rate to VX
+void opcode_FX3A(CHIP8 *chip, const CHIP8_INST *inst);
+#endif
 
 #endif
\ No newline at end of file
@@ -1,74 +1,584 @@
 #include "emulator.h"
 
-#include <sys/time.h>
-#include <unistd.h>
+#include <signal.h>
+#include <time.h>
 
+#include "capture.h"
 #include "chip8.h"
+#include "headless.h"
+#include "movie.h"
+#include "profile.h"
+#include "stream.h"
+#ifdef CHIP8_AOT
+#include "aot.h"
+#endif
+#ifndef CHIP8_NO_SDL
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "port.h"
+#endif
 
 static CHIP8* chip8;
+// frames written with --capture, NULL otherwise
+static CAPTURE* capture;
+// viewers served with --stream, NULL otherwise
+static STREAM* stream;
+// dumps and hashes, moved to stderr when the capture takes stdout
+static FILE* report;
+#ifndef CHIP8_NO_SDL
+// session being recorded with --record, NULL otherwise
+static MOVIE* movie;
+static uint32_t rgba[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+// framebuffer currently on screen
+static DISPLAY_ROW presented[DISPLAY_PLANES * DISPLAY_HEIGHT];
+static uint8_t presented_valid;
+
+#define FRAME_INDEX 3
+#define FRAME_FRESH 4
+/**
+ * Lock-free triple buffer passing finished frames from the emulation thread
+ * to the render thread. The emulation thread fills the back buffer and swaps
+ * it with the middle one; the render thread swaps the middle one with the
+ * front buffer when it holds a newer frame. Neither side ever waits and the
+ * render thread always gets the newest frame.
+ */
+static struct {
+  DISPLAY_ROW buffers[3][DISPLAY_PLANES * DISPLAY_HEIGHT];
+  int back;           // emulation thread only
+  int front;          // render thread only
+  atomic_int middle;  // index of the middle buffer, FRAME_FRESH until taken
+} frames = {.back = 0, .front = 1, .middle = 2};
+
+// keys held down as seen by the render thread, bit i for key i
+static _Atomic uint16_t key_mask;
+// run state chosen on the render thread: running, paused or quit
+static _Atomic enum sys_state ui_state = SYS_RUNNING;
+// set when the emulation thread stops, the program may end by itself
+static atomic_bool emulation_done;
+// wakes the emulation thread out of pause and idle waits
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+// frames the scheduler may run back to back to catch up after a stall
+#define MAX_CATCH_UP 5
 
-long current_micros() {
-  struct timeval time;
-  gettimeofday(&time, NULL);
-  return time.tv_sec * 1000000 + time.tv_usec;
+/**
+ * Move an absolute deadline forward by `nanos`
+ */
+static void deadline_add(struct timespec* deadline, long nanos) {
+  deadline->tv_nsec += nanos;
+  while (deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_nsec -= 1000000000L;
+    deadline->tv_sec++;
+  }
 }
 
-int main(int argc, char const* argv[]) {
-  chip8 = chip8_init();
-  if (!chip8) {
+/**
+ * Nanoseconds from `a` to `b`
+ */
+static long long deadline_diff(struct timespec* a, struct timespec* b) {
+  return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+/**
+ * Sleep until an absolute CLOCK_MONOTONIC deadline
+ */
+static void sleep_until(struct timespec* deadline) {
+#ifdef __APPLE__
+  // no clock_nanosleep on macOS, sleep for the remaining time instead
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long nanos = deadline_diff(&now, deadline);
+  if (nanos > 0) {
+    struct timespec rest = {nanos / 1000000000LL, nanos % 1000000000LL};
+    nanosleep(&rest, NULL);
+  }
+#else
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+#endif
+}
+
+/**
+ * Sleep until the next frame `deadline`, or give up on the backlog when more
+ * than MAX_CATCH_UP frames late
+ */
+static void pace_frame(struct timespec* deadline) {
+  const long frame_nanos = TIMER_DELAY * 1000L;
+  deadline_add(deadline, frame_nanos);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long late = deadline_diff(deadline, &now);
+  if (late > MAX_CATCH_UP * frame_nanos) {
+    *deadline = now;
+  } else if (late < 0) {
+    sleep_until(deadline);
+  }
+}
+
+/**
+ * Load a ROM file, in AOT builds `-` loads the translated ROM built in
+ */
+static uint8_t load_rom(const char* rom_name) {
+#ifdef CHIP8_AOT
+  if (strcmp(rom_name, "-") == 0) {
+    return chip8_load_bytes(chip8, aot_rom, aot_rom_size);
+  }
+#endif
+  return chip8_load_rom(chip8, rom_name);
+}
+
+static void usage() {
+#ifndef CHIP8_NO_SDL
+  printf(
+      "usage: ./emulator [--stream <port|socket path>] [--record <movie>] "
+      "<frequency> <rom name>\n");
+#else
+  printf(
+      "usage: ./emulator --stream <port|socket path> <frequency> "
+      "<rom name>\n");
+#endif
+  printf(
+      "       ./emulator --headless [--jit] <frequency> <rom name> "
+      "<cycles>[f] [dump file]\n");
+  printf("       ./emulator --replay <movie> <rom name> [hash interval]\n");
+  printf(
+      "every mode takes [--quirks <default|vip|schip|xo|flags>] "
+      "[--capture <file.y4m|file.rgba|->] [--capture-scale <n>] first, "
+      "replays run with the quirks of the movie\n");
+#ifdef CHIP8_AOT
+  printf("rom name `-` runs the built-in %s\n", aot_rom_name);
+#endif
+}
+
+/**
+ * Headless turbo mode: run a fixed number of cycles (or frames with the `f`
+ * suffix) without display and throttling, then report the speed and dump the
+ * final state. `--jit` selects the recompiler instead of the interpreter.
+ */
+static int run_headless(int argc, char const* argv[]) {
+  enum backend backend = BACKEND_INTERP;
+  if (argc > 2 && strcmp(argv[2], "--jit") == 0) {
+    backend = BACKEND_JIT;
+    argc--;
+    argv++;
+  }
+  if (argc != 5 && argc != 6) {
+    usage();
     return -1;
   }
-  // 1. load ROM file
-  const char* rom_name;
-  int frequency = CYCLE_FREQUENCY;
-  if (argc == 3) {
-    frequency = atoi(argv[1]);
-    rom_name = argv[2];
-  } else {
-    printf("usage: ./emulator <frequency> <rom name>\n");
+  int frequency = atoi(argv[2]);
+  const char* rom_name = argv[3];
+  char* end;
+  uint64_t count = strtoull(argv[4], &end, 10);
+  uint64_t frames = 0;
+  if (frequency <= 0) {
+    usage();
     return -1;
   }
-  if (!chip8_load_rom(chip8, rom_name)) {
+  if (*end == 'f') {
+    frames = count;
+    count = UINT64_MAX;
+  }
+  if (!load_rom(rom_name)) {
     return -1;
   }
 
-  if (!init_display("CHIP-8", 10, DISPLAY_WIDTH, DISPLAY_HEIGHT)) {
+  HEADLESS_STATS stats;
+  chip8_run_headless(chip8, count, frames, frequency, backend, capture,
+                     &stats);
+  headless_print_stats(&stats, stderr);
+
+  FILE* out = report;
+  if (argc == 6 && !(out = fopen(argv[5], "w"))) {
+    printf("open dump file error\n");
     return -1;
   }
+  chip8_dump_state(chip8, out);
+  if (out != report) {
+    fclose(out);
+  }
+  return 0;
+}
 
-  long last_cycle_time = current_micros();
-  long last_timer_time = current_micros();
-  // 2. emulator loop
-  while (chip8->state) {
-    // 2.0 handle user input
-    do {
-      handle_keypad(chip8->keys, chip8);
-      // pause system if you press spacebar, press again to continue
-    } while (chip8->state == SYS_PAUSE);
-
-    long now = current_micros();
-    // 2.1 update timer
-    if (now - last_timer_time >= TIMER_DELAY) {
-      last_timer_time = now;
-      chip8_timer(chip8);
-    }
-    if (now - last_cycle_time >= CYCLE_DELAY(frequency)) {
-      last_cycle_time = now;
-      // 2.2 fetch/decode/execute instruction
-      chip8_cycle(chip8);
-      // 2.3 refresh display
-      if (chip8->display_refresh_flag) {
-        handle_display(chip8->display, sizeof(chip8->display[0]));
+/**
+ * Replay a recorded movie headless, print framebuffer hashes and check them
+ * against the ones recorded with the movie.
+ */
+static int run_replay(int argc, char const* argv[]) {
+  if (argc != 4 && argc != 5) {
+    usage();
+    return -1;
+  }
+  MOVIE* replay = movie_load(argv[2]);
+  if (!replay) {
+    return -1;
+  }
+  uint32_t hash_interval = argc == 5 ? atoi(argv[4]) : 0;
+  if (replay->header.quirks != chip8->image->quirks) {
+    chip8_free(chip8);
+    chip8 = chip8_init_quirks(replay->header.quirks);
+  }
+  if (!chip8 || !load_rom(argv[3])) {
+    movie_free(replay);
+    return -1;
+  }
+  if (movie_rom_hash(chip8) != replay->header.rom_hash) {
+    printf("movie was recorded with another rom\n");
+    movie_free(replay);
+    return -1;
+  }
+
+  HEADLESS_STATS stats;
+  uint32_t mismatches =
+      movie_replay(replay, chip8, hash_interval, report, capture, &stats);
+  headless_print_stats(&stats, stderr);
+  if (mismatches) {
+    printf("%u of %u hashes differ from the recording\n", mismatches,
+           replay->header.hash_count);
+  }
+  movie_free(replay);
+  return mismatches ? 1 : 0;
+}
+
+#ifdef CHIP8_NO_SDL
+// set by SIGINT and SIGTERM, ends a window-less stream
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop(int sig) { stop_requested = 1; }
+
+/**
+ * Window-less real-time run for --stream: the viewers press the keys and
+ * watch the frames, paced like the emulation thread of the SDL window
+ */
+static int run_stream(int frequency) {
+  signal(SIGINT, on_stop);
+  signal(SIGTERM, on_stop);
+  uint64_t frame = 0;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (chip8->state && !stop_requested) {
+    chip8_set_keys(chip8, stream_keys(stream));
+    headless_run_frame(chip8, frequency, frame++);
+    chip8_timer(chip8);
+    capture_frame(capture, chip8);
+    stream_frame(stream, chip8);
+    pace_frame(&deadline);
+  }
+  return 0;
+}
+#else
+/**
+ * Publish the framebuffer as the newest finished frame: fill the back buffer
+ * and swap it into the middle. Never waits for the render thread.
+ */
+static void publish_frame() {
+  memcpy(frames.buffers[frames.back], chip8->display, sizeof(chip8->display));
+  int old = atomic_exchange(&frames.middle, frames.back | FRAME_FRESH);
+  frames.back = old & FRAME_INDEX;
+  // a fresh frame left unread still has its wakeup queued
+  if (!(old & FRAME_FRESH)) {
+    notify_frame();
+  }
+}
+
+/**
+ * Swap the newest finished frame, if there is one, into the front buffer
+ */
+static uint8_t take_frame() {
+  if (!(atomic_load(&frames.middle) & FRAME_FRESH)) {
+    return 0;
+  }
+  frames.front = atomic_exchange(&frames.middle, frames.front) & FRAME_INDEX;
+  return 1;
+}
+
+/**
+ * Hand keys and run state from the render thread to the emulation thread and
+ * wake it if it sleeps in a pause or idle wait
+ */
+static void publish_input(uint16_t keys, enum sys_state state) {
+  if (keys == atomic_load(&key_mask) && state == atomic_load(&ui_state)) {
+    return;
+  }
+  pthread_mutex_lock(&wake_lock);
+  atomic_store(&key_mask, keys);
+  atomic_store(&ui_state, state);
+  pthread_cond_broadcast(&wake_cond);
+  pthread_mutex_unlock(&wake_lock);
+}
+
+/**
+ * Row y of `display` differs from the one on screen in any plane
+ */
+static uint8_t row_changed(const DISPLAY_ROW* display, int y) {
+  for (int p = y; p < DISPLAY_PLANES * DISPLAY_HEIGHT; p += DISPLAY_HEIGHT) {
+    if (display[p] != presented[p]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Present a finished frame. Frames equal to the one on screen are skipped and
+ * only the changed rows are uploaded.
+ */
+static void present_frame(const DISPLAY_ROW* display) {
+  uint8_t dirty = 0;
+  int y = 0;
+  while (y < DISPLAY_HEIGHT) {
+    if (presented_valid && !row_changed(display, y)) {
+      y++;
+      continue;
+    }
+    // upload the run of changed rows starting here in one go
+    int first = y;
+    while (y < DISPLAY_HEIGHT &&
+           (!presented_valid || row_changed(display, y))) {
+      for (int p = y; p < DISPLAY_PLANES * DISPLAY_HEIGHT;
+           p += DISPLAY_HEIGHT) {
+        presented[p] = display[p];
+      }
+      y++;
+    }
+    chip8_display_rgba(display + first, y - first, rgba + first);
+    update_display(rgba[first], sizeof(rgba[0]), first, y - first);
+    dirty = 1;
+  }
+  presented_valid = 1;
+  if (dirty) {
+    present_display();
+  }
+}
+
+/**
+ * Emulation thread, the frame scheduler: every 1/60 s pick up the keys, run a
+ * burst of frequency/60 instructions (a frame of the VIP clock with
+ * QUIRK_VIP_CLOCK), tick the timers once and publish the frame, then sleep
+ * until the next absolute deadline. After a stall it runs
+ * up to MAX_CATCH_UP late frames back to back before giving up on the
+ * backlog. Presentation happens on the render thread and can't stall it.
+ */
+static void* emulate(void* arg) {
+  int frequency = *(int*)arg;
+  uint64_t frame = 0;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (chip8->state && atomic_load(&ui_state) != SYS_QUIT) {
+    chip8_set_keys(chip8, atomic_load(&key_mask) | stream_keys(stream));
+    if (atomic_load(&ui_state) == SYS_PAUSE) {
+      // paused with the spacebar, sleep until pressed again
+      pthread_mutex_lock(&wake_lock);
+      while (atomic_load(&ui_state) == SYS_PAUSE) {
+        pthread_cond_wait(&wake_cond, &wake_lock);
       }
-      if (chip8->sound_timer > 0) {
-        handle_sound();
+      pthread_mutex_unlock(&wake_lock);
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      continue;
+    }
+
+    // waiting for a key with both timers stopped, or halted: nothing can
+    // change before the keys do, so sleep until they change. Keys from
+    // stream viewers don't wake it, keep running frames for them.
+    enum chip8_idle idle = chip8_idle(chip8);
+    if (!stream && (idle == IDLE_KEY || idle == IDLE_HALT) && !chip8->delay_timer &&
+        !chip8->sound_timer) {
+      uint16_t keys = chip8_key_mask(chip8);
+      pthread_mutex_lock(&wake_lock);
+      while (atomic_load(&ui_state) == SYS_RUNNING &&
+             atomic_load(&key_mask) == keys) {
+        pthread_cond_wait(&wake_cond, &wake_lock);
       }
+      pthread_mutex_unlock(&wake_lock);
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      continue;
+    }
+
+    // 2.1 fetch/decode/execute one frame worth of instructions, a frame spent
+    // in an idle loop is skipped
+    if (movie) {
+      movie_input(movie, chip8);
+    }
+    uint32_t cycles = headless_run_frame(chip8, frequency, frame++);
+    // 2.2 update timer
+    chip8_timer(chip8);
+    capture_frame(capture, chip8);
+    stream_frame(stream, chip8);
+    if (movie) {
+      movie_frame(movie, chip8, cycles);
+    }
+    // 2.3 hand the frame to the render thread
+    if (chip8->display_refresh_flag) {
+      chip8->display_refresh_flag = 0;
+      publish_frame();
+    }
+    if (chip8->sound_timer > 0) {
+      handle_sound(chip8);
+    }
+
+    // 2.4 sleep until the next frame
+    pace_frame(&deadline);
+  }
+  atomic_store(&emulation_done, 1);
+  notify_frame();
+  return NULL;
+}
+
+/**
+ * Render thread, the main one: sleep until an input event or a finished frame
+ * arrives, pass the keys on and present the newest frame.
+ */
+static int run_display(int frequency) {
+  // same window size for every variant
+  if (!init_display("CHIP-8", 640 / DISPLAY_WIDTH, DISPLAY_WIDTH,
+                    DISPLAY_HEIGHT)) {
+    return -1;
+  }
+  if (!init_sound()) {
+    fprintf(stderr, "no audio device, running silent\n");
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, emulate, &frequency) != 0) {
+    close_sound();
+    close_display();
+    return -1;
+  }
+  // 2. event loop
+  uint8_t keys[KEY_SIZE] = {0};
+  enum sys_state state = SYS_RUNNING;
+  while (state != SYS_QUIT && !atomic_load(&emulation_done)) {
+    wait_keypad(keys, &state);
+    uint16_t mask = 0;
+    for (int i = 0; i < KEY_SIZE; i++) {
+      mask |= (keys[i] ? 1 : 0) << i;
+    }
+    publish_input(mask, state);
+    if (take_frame()) {
+      present_frame(frames.buffers[frames.front]);
     }
-    // not busy running
-    usleep(100);
   }
+  publish_input(atomic_load(&key_mask), SYS_QUIT);
+  pthread_join(thread, NULL);
+  close_sound();
   close_display();
-  free(chip8);
   return 0;
 }
+#endif
+
+int main(int argc, char const* argv[]) {
+  profile_init();
+  // quirk, capture and stream options go before the mode
+  report = stdout;
+  const char* capture_name = NULL;
+  const char* stream_address = NULL;
+  int capture_scale = 640 / DISPLAY_WIDTH;
+#ifdef CHIP8_AOT
+  uint32_t quirks = aot_quirks;
+#else
+  uint32_t quirks = 0;
+#endif
+  while (argc > 2 && (strcmp(argv[1], "--quirks") == 0 ||
+                      strcmp(argv[1], "--capture") == 0 ||
+                      strcmp(argv[1], "--capture-scale") == 0 ||
+                      strcmp(argv[1], "--stream") == 0)) {
+    if (strcmp(argv[1], "--quirks") == 0) {
+      if (!chip8_parse_quirks(argv[2], &quirks)) {
+        usage();
+        return -1;
+      }
+    } else if (strcmp(argv[1], "--capture") == 0) {
+      capture_name = argv[2];
+      report = strcmp(capture_name, "-") == 0 ? stderr : stdout;
+    } else if (strcmp(argv[1], "--stream") == 0) {
+      stream_address = argv[2];
+    } else {
+      capture_scale = atoi(argv[2]);
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  chip8 = chip8_init_quirks(quirks);
+  if (!chip8) {
+    return -1;
+  }
+  // only the SDL window runs in real time, the other modes keep every frame
+  int realtime = !(argc > 1 && (strcmp(argv[1], "--headless") == 0 ||
+                                strcmp(argv[1], "--replay") == 0));
+  if (capture_name &&
+      !(capture = capture_open(capture_name, capture_format_of(capture_name),
+                               capture_scale, realtime))) {
+    chip8_free(chip8);
+    return -1;
+  }
+  int ret;
+  if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+    ret = run_headless(argc, argv);
+  } else if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+    ret = run_replay(argc, argv);
+  } else {
+#ifndef CHIP8_NO_SDL
+    const char* movie_name = NULL;
+    if (argc > 2 && strcmp(argv[1], "--record") == 0) {
+      movie_name = argv[2];
+      argc -= 2;
+      argv += 2;
+    }
+    // 1. load ROM file
+    const char* rom_name;
+    int frequency = CYCLE_FREQUENCY;
+    if (argc == 3) {
+      frequency = atoi(argv[1]);
+      rom_name = argv[2];
+    }
+    if (argc != 3 || frequency <= 0) {
+      usage();
+      chip8_free(chip8);
+      return -1;
+    }
+    if (!load_rom(rom_name)) {
+      chip8_free(chip8);
+      return -1;
+    }
+    if (stream_address && !(stream = stream_open(stream_address))) {
+      chip8_free(chip8);
+      return -1;
+    }
+    if (movie_name) {
+      movie = movie_new(chip8, (uint32_t)time(NULL), frequency,
+                        MOVIE_HASH_INTERVAL);
+    }
+    ret = run_display(frequency);
+    if (movie) {
+      if (!movie_save(movie, movie_name)) {
+        ret = -1;
+      }
+      movie_free(movie);
+    }
+#else
+    // no window to show, only the stream runs in real time
+    if (!stream_address || argc != 3) {
+      usage();
+      chip8_free(chip8);
+      return -1;
+    }
+    int frequency = atoi(argv[1]);
+    if (frequency <= 0 || !load_rom(argv[2]) ||
+        !(stream = stream_open(stream_address))) {
+      chip8_free(chip8);
+      return -1;
+    }
+    ret = run_stream(frequency);
+#endif
+    stream_close(stream);
+  }
+  uint64_t dropped = capture_close(capture);
+  if (dropped) {
+    fprintf(stderr, "capture dropped %llu frames\n",
+            (unsigned long long)dropped);
+  }
+  chip8_free(chip8);
+  return ret;
+}
@@ -0,0 +1,107 @@
+#include "env.h"
+
+#include "headless.h"
+
+/**
+ * @brief create an environment running from a shared memory image
+ * @param  *image: fonts and ROM from chip8_image_new(), must outlive the
+ * environment
+ * @param  frequency: emulated CPU frequency, ignored with QUIRK_VIP_CLOCK
+ * @param  seed: random number seed for CXNN
+ * @retval the environment, NULL when out of memory
+ */
+CHIP8_ENV *chip8_env_new(const CHIP8_IMAGE *image, int frequency,
+                         uint32_t seed) {
+  CHIP8_ENV *env = calloc(1, sizeof(CHIP8_ENV));
+  if (!env) {
+    return NULL;
+  }
+  env->chip8 = chip8_init_image(image);
+  if (!env->chip8) {
+    free(env);
+    return NULL;
+  }
+  chip8_seed(env->chip8, seed);
+  env->frequency = frequency;
+  return env;
+}
+
+/**
+ * @brief start a new episode: back to the state right after the ROM loaded
+ * @param  *env: environment
+ * @param  seed: random number seed for CXNN
+ * @retval 0 when out of memory, the environment is left as it was
+ */
+uint8_t chip8_env_reset(CHIP8_ENV *env, uint32_t seed) {
+  CHIP8 *chip8 = chip8_init_image(env->chip8->image);
+  if (!chip8) {
+    return 0;
+  }
+  chip8_free(env->chip8);
+  env->chip8 = chip8;
+  chip8_seed(chip8, seed);
+  env->frame = 0;
+  return 1;
+}
+
+void chip8_env_free(CHIP8_ENV *env) {
+  if (!env) {
+    return;
+  }
+  chip8_free(env->chip8);
+  free(env);
+}
+
+/**
+ * @brief hold `keys` down for `frames` frames, then observe
+ * @note frames run on the virtual clock like every headless mode: the same
+ * keys and seed always give the same observations
+ * @param  *env: environment
+ * @param  keys: bit i for key i
+ * @param  frames: 60 Hz frames to run
+ * @param  *obs: filled with the state after the last frame, may be NULL
+ * @retval None
+ */
+void chip8_env_step(CHIP8_ENV *env, uint16_t keys, uint32_t frames,
+                    CHIP8_OBS *obs) {
+  CHIP8 *chip8 = env->chip8;
+  chip8_set_keys(chip8, keys);
+  chip8->display_refresh_flag = 0;
+  for (uint32_t i = 0; i < frames && chip8->state != SYS_QUIT; i++) {
+    headless_run_frame(chip8, env->frequency, env->frame++);
+    chip8_timer(chip8);
+  }
+  if (!obs) {
+    return;
+  }
+  chip8_display_bytes(chip8->display, obs->display);
+  memcpy(obs->reg, chip8->reg, sizeof(obs->reg));
+  obs->index_reg = chip8->index_reg;
+  obs->pc = chip8->pc;
+  obs->delay_timer = chip8->delay_timer;
+  obs->sound_timer = chip8->sound_timer;
+  obs->halted = chip8->state == SYS_QUIT;
+  obs->display_changed = chip8->display_refresh_flag;
+}
+
+/**
+ * @brief step `count` environments in one call, each with its own keys
+ * @param  *envs: environments
+ * @param  *keys: key mask of every environment
+ * @param  count: number of environments
+ * @param  frames: 60 Hz frames to run each
+ * @param  *obs: `count` observations in the order of `envs`, may be NULL
+ * @retval None
+ */
+void chip8_env_step_batch(CHIP8_ENV *const *envs, const uint16_t *keys,
+                          size_t count, uint32_t frames, CHIP8_OBS *obs) {
+  for (size_t i = 0; i < count; i++) {
+    chip8_env_step(envs[i], keys[i], frames, obs ? obs + i : NULL);
+  }
+}
+
+/**
+ * @brief bytes of one observation, for callers without sizeof(CHIP8_OBS)
+ * @retval sizeof(CHIP8_OBS) of the variant the library was built for
+ */
+size_t chip8_env_obs_size() { return sizeof(CHIP8_OBS); }
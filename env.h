@@ -0,0 +1,53 @@
+#ifndef __ENV_H__
+#define __ENV_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/**
+ * Step API of libchip8, for agents and other programs driving many instances
+ * frame by frame. Load a ROM once with chip8_image_new() and create any number
+ * of environments from the image, they share its memory copy-on-write. Each
+ * step holds a key mask for some frames and reports an observation.
+ * Environments are independent: threads may step disjoint ones at once.
+ */
+typedef struct chip8_env {
+  CHIP8 *chip8;
+  int frequency;   // emulated CPU frequency
+  uint64_t frame;  // frames run since the last reset
+} CHIP8_ENV;
+
+/**
+ * What an environment looks like after a step. The layout is fixed for a
+ * variant, an array of them is one contiguous block with chip8_env_obs_size()
+ * bytes per environment.
+ */
+typedef struct chip8_obs {
+  uint8_t display[DISPLAY_BYTES];  // packed by chip8_display_bytes()
+  uint8_t reg[16];
+  uint16_t index_reg;
+  uint16_t pc;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint8_t halted;           // exited with 00FD, further steps do nothing
+  uint8_t display_changed;  // the step drew or cleared
+} CHIP8_OBS;
+
+CHIP8_ENV *chip8_env_new(const CHIP8_IMAGE *image, int frequency,
+                         uint32_t seed);
+
+uint8_t chip8_env_reset(CHIP8_ENV *env, uint32_t seed);
+
+void chip8_env_free(CHIP8_ENV *env);
+
+void chip8_env_step(CHIP8_ENV *env, uint16_t keys, uint32_t frames,
+                    CHIP8_OBS *obs);
+
+void chip8_env_step_batch(CHIP8_ENV *const *envs, const uint16_t *keys,
+                          size_t count, uint32_t frames, CHIP8_OBS *obs);
+
+size_t chip8_env_obs_size();
+
+#endif  //__ENV_H__
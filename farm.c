@@ -0,0 +1,396 @@
+/**
+ * ROM farm: run many independent headless instances across all cores.
+ *
+ * Every combination of ROM, seed and held key mask is one job. Jobs are split
+ * into one contiguous range per worker thread; a worker takes jobs from the
+ * front of its own range and, once it runs dry, steals the back half of
+ * another worker's range. Each job owns its CHIP8 instance and PRNG seed, so
+ * results only depend on the job and not on which thread ran it. Instances
+ * of one ROM share its memory image and only allocate the pages they write.
+ * ROMs from a pack run with the quirks stored for them, ROM files with -q.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "chip8.h"
+#include "headless.h"
+#include "pack.h"
+#include "profile.h"
+
+typedef struct farm_rom {
+  const char *name;
+  const uint8_t *data;  // read from a file, or straight from a mapped pack
+  size_t size;
+  int frequency;  // preferred frequency, 0 for the farm's
+  uint32_t quirks;
+  CHIP8_IMAGE *image;
+} FARM_ROM;
+
+typedef struct farm_result {
+  HEADLESS_STATS stats;
+  uint64_t hash;  // framebuffer hash at the end of the run
+  uint16_t pc;
+  uint16_t index_reg;
+  uint8_t reg[16];
+} FARM_RESULT;
+
+typedef struct farm_worker {
+  // pending jobs [next, end) packed as next | end << 32, updated with CAS by
+  // the owner (front) and thieves (back)
+  _Atomic uint64_t range;
+  pthread_t thread;
+  struct farm *farm;
+  int id;
+} FARM_WORKER;
+
+typedef struct farm {
+  FARM_ROM *roms;
+  int rom_count;
+  uint32_t seed_count;
+  uint32_t seed_base;
+  uint16_t *masks;
+  int mask_count;
+  uint64_t cycles;
+  int frequency;
+  enum backend backend;
+  const char *video_dir;  // one Y4M per job when set
+  int video_scale;
+
+  uint32_t job_count;
+  FARM_RESULT *results;
+  FARM_WORKER *workers;
+  int worker_count;
+} FARM;
+
+#define RANGE(next, end) ((uint64_t)(next) | (uint64_t)(end) << 32)
+#define RANGE_NEXT(range) ((uint32_t)(range))
+#define RANGE_END(range) ((uint32_t)((range) >> 32))
+
+// job index -> rom, seed and key mask, the rom varies slowest
+static void job_params(FARM *farm, uint32_t job, int *rom, uint32_t *seed,
+                       int *mask) {
+  *mask = job % farm->mask_count;
+  job /= farm->mask_count;
+  *seed = farm->seed_base + job % farm->seed_count;
+  *rom = job / farm->seed_count;
+}
+
+static void run_job(FARM *farm, uint32_t job) {
+  int rom, mask;
+  uint32_t seed;
+  job_params(farm, job, &rom, &seed, &mask);
+  FARM_RESULT *result = &farm->results[job];
+  CHIP8 *chip8 = chip8_init_image(farm->roms[rom].image);
+  if (!chip8) {
+    return;
+  }
+  chip8_seed(chip8, seed);
+  chip8_set_keys(chip8, farm->masks[mask]);
+  CAPTURE *capture = NULL;
+  if (farm->video_dir) {
+    const char *name = strrchr(farm->roms[rom].name, '/');
+    name = name ? name + 1 : farm->roms[rom].name;
+    char file_name[4096];
+    snprintf(file_name, sizeof(file_name), "%s/%s-%u-%04x.y4m",
+             farm->video_dir, name, seed, farm->masks[mask]);
+    capture = capture_open(file_name, CAPTURE_Y4M, farm->video_scale, 0);
+  }
+  int frequency = farm->roms[rom].frequency;
+  chip8_run_headless(chip8, farm->cycles, 0,
+                     frequency ? frequency : farm->frequency, farm->backend,
+                     capture, &result->stats);
+  capture_close(capture);
+  result->hash = headless_display_hash(chip8);
+  result->pc = chip8->pc;
+  result->index_reg = chip8->index_reg;
+  memcpy(result->reg, chip8->reg, sizeof(result->reg));
+  chip8_free(chip8);
+}
+
+// take the job at the front of our own range
+static int take_job(FARM_WORKER *worker, uint32_t *job) {
+  uint64_t range = atomic_load(&worker->range);
+  while (RANGE_NEXT(range) < RANGE_END(range)) {
+    uint64_t taken = RANGE(RANGE_NEXT(range) + 1, RANGE_END(range));
+    if (atomic_compare_exchange_weak(&worker->range, &range, taken)) {
+      *job = RANGE_NEXT(range);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// move the back half of some other worker's range into our own
+static int steal_jobs(FARM_WORKER *thief) {
+  FARM *farm = thief->farm;
+  for (int i = 1; i < farm->worker_count; i++) {
+    FARM_WORKER *victim = &farm->workers[(thief->id + i) % farm->worker_count];
+    uint64_t range = atomic_load(&victim->range);
+    while (RANGE_NEXT(range) < RANGE_END(range)) {
+      uint32_t next = RANGE_NEXT(range);
+      uint32_t end = RANGE_END(range);
+      uint32_t mid = next + (end - next) / 2;
+      if (atomic_compare_exchange_weak(&victim->range, &range,
+                                       RANGE(next, mid))) {
+        atomic_store(&thief->range, RANGE(mid, end));
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void *worker_main(void *arg) {
+  FARM_WORKER *worker = arg;
+  uint32_t job;
+  for (;;) {
+    if (take_job(worker, &job)) {
+      run_job(worker->farm, job);
+    } else if (!steal_jobs(worker)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Run every job on `threads` threads and wait for all of them, 0 when out of
+ * memory
+ */
+static uint8_t farm_run(FARM *farm, int threads) {
+  farm->results = calloc(farm->job_count, sizeof(FARM_RESULT));
+  farm->workers = calloc(threads, sizeof(FARM_WORKER));
+  if (!farm->results || !farm->workers) {
+    return 0;
+  }
+  farm->worker_count = threads;
+  for (int i = 0; i < threads; i++) {
+    uint32_t begin = (uint64_t)farm->job_count * i / threads;
+    uint32_t end = (uint64_t)farm->job_count * (i + 1) / threads;
+    farm->workers[i].farm = farm;
+    farm->workers[i].id = i;
+    atomic_init(&farm->workers[i].range, RANGE(begin, end));
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_create(&farm->workers[i].thread, NULL, worker_main,
+                   &farm->workers[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(farm->workers[i].thread, NULL);
+  }
+  return 1;
+}
+
+/**
+ * One JSON object per run, in job order
+ */
+static void farm_report(FARM *farm, FILE *out) {
+  for (uint32_t job = 0; job < farm->job_count; job++) {
+    int rom, mask;
+    uint32_t seed;
+    job_params(farm, job, &rom, &seed, &mask);
+    FARM_RESULT *result = &farm->results[job];
+    fprintf(out,
+            "{\"rom\":\"%s\",\"seed\":%u,\"keys\":%u,\"cycles\":%llu,"
+            "\"frames\":%llu,\"seconds\":%.6f,\"ips\":%.0f,"
+            "\"hash\":\"%016llx\",\"pc\":%u,\"i\":%u,\"v\":[",
+            farm->roms[rom].name, seed, farm->masks[mask],
+            (unsigned long long)result->stats.cycles,
+            (unsigned long long)result->stats.frames, result->stats.seconds,
+            result->stats.ips, (unsigned long long)result->hash, result->pc,
+            result->index_reg);
+    for (int i = 0; i < 16; i++) {
+      fprintf(out, "%u%s", result->reg[i], i == 15 ? "]}\n" : ",");
+    }
+  }
+}
+
+static int read_rom(FARM_ROM *rom, const char *name) {
+  FILE *file = fopen(name, "rb");
+  if (!file) {
+    fprintf(stderr, "open rom error: %s\n", name);
+    return 0;
+  }
+  uint8_t *data = malloc(MEM_SIZE - MEM_START);
+  if (!data) {
+    fclose(file);
+    return 0;
+  }
+  rom->name = name;
+  rom->data = data;
+  rom->size = fread(data, 1, MEM_SIZE - MEM_START, file);
+  fclose(file);
+  return 1;
+}
+
+static void usage() {
+  printf(
+      "usage: ./chip8-farm [-j threads] [-c cycles] [-f frequency] "
+      "[-s seeds] [-S first seed] [-k mask,mask,...] [-q quirks] [-J] "
+      "[-o output] [-p pack] [-V video dir] [-z video scale] [rom]...\n");
+}
+
+int main(int argc, char *const argv[]) {
+  profile_init();
+  FARM farm = {0};
+  farm.cycles = 1000000;
+  farm.frequency = CYCLE_FREQUENCY;
+  farm.seed_count = 1;
+  farm.seed_base = 1;
+  farm.backend = BACKEND_INTERP;
+  farm.video_scale = 640 / DISPLAY_WIDTH;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *keys = "0";
+  const char *output = NULL;
+  PACK *pack = NULL;
+  uint32_t quirks = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:c:f:s:S:k:q:Jo:p:V:z:h")) != -1) {
+    switch (opt) {
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'c':
+        farm.cycles = strtoull(optarg, NULL, 10);
+        break;
+      case 'f':
+        farm.frequency = atoi(optarg);
+        break;
+      case 's': {
+        // a count that doesn't fit must not wrap to a smaller sweep
+        char *end;
+        unsigned long long seeds = strtoull(optarg, &end, 10);
+        if (*optarg == '-' || *end || seeds > UINT32_MAX) {
+          usage();
+          return -1;
+        }
+        farm.seed_count = seeds;
+        break;
+      }
+      case 'S':
+        farm.seed_base = strtoul(optarg, NULL, 10);
+        break;
+      case 'k':
+        keys = optarg;
+        break;
+      case 'q':
+        if (!chip8_parse_quirks(optarg, &quirks)) {
+          usage();
+          return -1;
+        }
+        break;
+      case 'J':
+        farm.backend = BACKEND_JIT;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'p':
+        // every ROM of a pack, opened with one mmap
+        pack_close(pack);
+        if (!(pack = pack_open(optarg))) {
+          return -1;
+        }
+        break;
+      case 'V':
+        farm.video_dir = optarg;
+        break;
+      case 'z':
+        farm.video_scale = atoi(optarg);
+        break;
+      default:
+        usage();
+        return -1;
+    }
+  }
+  if ((optind >= argc && !pack) || threads <= 0 || farm.frequency <= 0 ||
+      farm.seed_count == 0 || farm.video_scale < 1) {
+    usage();
+    return -1;
+  }
+
+  // key masks held during the whole run, comma separated
+  farm.mask_count = 1;
+  for (const char *c = keys; *c; c++) {
+    farm.mask_count += *c == ',';
+  }
+  farm.masks = calloc(farm.mask_count, sizeof(uint16_t));
+  const char *c = keys;
+  for (int i = 0; i < farm.mask_count; i++) {
+    char *end;
+    farm.masks[i] = strtoul(c, &end, 0);
+    c = *end ? end + 1 : end;
+  }
+
+  int pack_count = pack ? pack->header->entry_count : 0;
+  farm.rom_count = pack_count + argc - optind;
+  farm.roms = calloc(farm.rom_count, sizeof(FARM_ROM));
+  for (int i = 0; i < pack_count; i++) {
+    const PACK_ENTRY *entry = &pack->entries[i];
+    farm.roms[i].name = pack_name(pack, entry);
+    farm.roms[i].data = pack_data(pack, entry);
+    farm.roms[i].size = entry->size;
+    farm.roms[i].frequency = entry->frequency;
+    farm.roms[i].quirks = entry->quirks;
+    // the image reads the ROM from the mapping
+    farm.roms[i].image = pack_image(pack, entry);
+  }
+  for (int i = pack_count; i < farm.rom_count; i++) {
+    if (!read_rom(&farm.roms[i], argv[optind + i - pack_count])) {
+      return -1;
+    }
+    farm.roms[i].quirks = quirks;
+  }
+  for (int i = 0; i < farm.rom_count; i++) {
+    if (!farm.roms[i].image &&
+        !(farm.roms[i].image = chip8_image_new(
+              farm.roms[i].data, farm.roms[i].size, farm.roms[i].quirks))) {
+      fprintf(stderr, "rom too large: %s\n", farm.roms[i].name);
+      return -1;
+    }
+  }
+
+  // every job is numbered and gets a result slot
+  uint64_t jobs = (uint64_t)farm.rom_count * farm.seed_count;
+  if (jobs > UINT32_MAX || jobs * farm.mask_count > UINT32_MAX) {
+    usage();
+    return -1;
+  }
+  farm.job_count = jobs * farm.mask_count;
+
+  double start = headless_seconds();
+  if (!farm_run(&farm, threads)) {
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+  double seconds = headless_seconds() - start;
+
+  FILE *out = stdout;
+  if (output && !(out = fopen(output, "w"))) {
+    fprintf(stderr, "open output error\n");
+    return -1;
+  }
+  farm_report(&farm, out);
+  if (out != stdout) {
+    fclose(out);
+  }
+  fprintf(stderr, "%u runs on %d threads in %.3f s (%.0f instructions/s)\n",
+          farm.job_count, threads, seconds,
+          seconds > 0 ? farm.job_count * (double)farm.cycles / seconds : 0);
+
+  free(farm.results);
+  free(farm.workers);
+  for (int i = 0; i < farm.rom_count; i++) {
+    chip8_image_free(farm.roms[i].image);
+  }
+  for (int i = pack_count; i < farm.rom_count; i++) {
+    free((void *)farm.roms[i].data);
+  }
+  free(farm.roms);
+  pack_close(pack);
+  free(farm.masks);
+  return 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * Fuzzing harness: arbitrary bytes run as a ROM on a reference core stepping
+ * with chip8_cycle() and a candidate on one of the fast paths, which must end
+ * every frame in the same state. Built with address and undefined behavior
+ * sanitizers, any out of bounds access in a handler or a divergence aborts.
+ *
+ * LLVMFuzzerTestOneInput() is the libFuzzer entry point. Without libFuzzer
+ * (CHIP8_LIBFUZZER undefined) main() runs the built-in seeds and the files
+ * given on the command line, then `-r` inputs made by mutating them.
+ *
+ * Input layout, everything past the header is the ROM:
+ *   0     quirks, masked with QUIRKS_ALL
+ *   1     candidate: bit 0 recompiler, bit 1 idle loop skipping
+ *   2, 3  key mask held during the odd frames, little endian
+ */
+#include <unistd.h>
+
+#include "chip8.h"
+#include "jit.h"
+#include "savestate.h"
+
+#define FUZZ_HEADER 4
+#define FUZZ_FRAMES 60
+#define FUZZ_FRAME_CYCLES 100
+// longest ROM loaded at MEM_START
+#define FUZZ_ROM_MAX (MEM_SIZE - MEM_START - 1)
+
+static CHIP8_JIT *jit;
+static CHIP8_SNAPSHOT reference_state;
+static CHIP8_SNAPSHOT candidate_state;
+
+/**
+ * Whole machine state of both cores, memory included. opcode is only kept up
+ * to date by chip8_cycle() and is left out.
+ */
+static int same_state(CHIP8 *reference, CHIP8 *candidate) {
+  candidate->opcode = reference->opcode;
+  chip8_snapshot(reference, &reference_state);
+  chip8_snapshot(candidate, &candidate_state);
+  return !memcmp(&reference_state, &candidate_state, sizeof(CHIP8_SNAPSHOT));
+}
+
+static void candidate_run(CHIP8 *chip8, uint8_t mode, uint32_t cycles) {
+  if ((mode & 2) && chip8_skip_idle(chip8, cycles)) {
+    return;
+  }
+  if ((mode & 1) && jit) {
+    jit_run(jit, chip8, cycles, 1);
+  } else {
+    chip8_run(chip8, cycles);
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < FUZZ_HEADER) {
+    return 0;
+  }
+  uint32_t quirks = data[0];
+  uint8_t mode = data[1];
+  uint16_t keys = data[2] | data[3] << 8;
+  size -= FUZZ_HEADER;
+  size = size < FUZZ_ROM_MAX ? size : FUZZ_ROM_MAX;
+  CHIP8_IMAGE *image = chip8_image_new(data + FUZZ_HEADER, size, quirks);
+  if (!image) {
+    return 0;
+  }
+  CHIP8 *reference = chip8_init_image(image);
+  CHIP8 *candidate = chip8_init_image(image);
+  if (!reference || !candidate) {
+    chip8_free(reference);
+    chip8_free(candidate);
+    chip8_image_free(image);
+    return 0;
+  }
+  if ((mode & 1) && !jit) {
+    jit = jit_init();
+  }
+  if (jit) {
+    jit_flush(jit);
+  }
+  chip8_seed(reference, keys);
+  chip8_seed(candidate, keys);
+
+  for (int frame = 0; frame < FUZZ_FRAMES; frame++) {
+    uint16_t mask = frame % 2 ? keys : 0;
+    chip8_set_keys(reference, mask);
+    chip8_set_keys(candidate, mask);
+    for (int i = 0; i < FUZZ_FRAME_CYCLES; i++) {
+      chip8_cycle(reference);
+    }
+    candidate_run(candidate, mode, FUZZ_FRAME_CYCLES);
+    chip8_timer(reference);
+    chip8_timer(candidate);
+    if (!same_state(reference, candidate)) {
+      fprintf(stderr, "cores differ after frame %d\n", frame);
+      abort();
+    }
+  }
+
+  // a savestate loaded into a running instance resumes identically
+  chip8_restore(candidate, &reference_state);
+  if (jit) {
+    jit_flush(jit);
+  }
+  for (int i = 0; i < FUZZ_FRAME_CYCLES; i++) {
+    chip8_cycle(reference);
+  }
+  candidate_run(candidate, mode, FUZZ_FRAME_CYCLES);
+  if (!same_state(reference, candidate)) {
+    fprintf(stderr, "cores differ after restoring a savestate\n");
+    abort();
+  }
+
+  chip8_free(reference);
+  chip8_free(candidate);
+  chip8_image_free(image);
+  return 0;
+}
+
+#ifndef CHIP8_LIBFUZZER
+
+// Regression seeds: self-modifying code the recompiler has missed before, all
+// run on the recompiler. The addresses assume 4K of memory.
+// FX1E takes I past the top of memory, F155 then rewrites a translated block
+static const uint8_t SEED_STORE_PAST_TOP[] = {
+    0x00, 0x01, 0x00, 0x00, 0x12, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x01, 0x61, 0x02,
+    0x62, 0x03, 0x63, 0x04, 0x35, 0x01, 0x12, 0x20, 0x12, 0x1C, 0x00, 0x00,
+    0xAF, 0xFF, 0x66, 0xFF, 0xF6, 0x1E, 0xF6, 0x1E, 0x66, 0x13, 0xF6, 0x1E,
+    0x60, 0x60, 0x61, 0x77, 0xF1, 0x55, 0x65, 0x01, 0x12, 0x10,
+};
+
+// F255 at I = 0xFFE wraps around and rewrites the block translated at 0x000
+static const uint8_t SEED_STORE_WRAPS[] = {
+    0x00, 0x01, 0x00, 0x00, 0xA0, 0x00, 0x60, 0x60, 0x61, 0x01, 0x62, 0x61,
+    0x63, 0x02, 0x64, 0x62, 0x65, 0x03, 0x66, 0x63, 0x67, 0x04, 0x68, 0x12,
+    0x69, 0x30, 0xF9, 0x55, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x3A, 0x01, 0x12, 0x36, 0x12, 0x34, 0xAF, 0xFE,
+    0x62, 0x65, 0xF2, 0x55, 0x6A, 0x01, 0x10, 0x00,
+};
+
+// FX29 in a translated block after page 0 became private
+static const uint8_t SEED_FONT_PRIVATE_PAGE[] = {
+    0x00, 0x01, 0x00, 0x00, 0xA0, 0x00, 0x60, 0x01, 0xF0, 0x55, 0x60, 0x30,
+    0xF0, 0x29, 0x61, 0x01, 0x62, 0x02, 0x63, 0x03, 0x64, 0x04, 0x12, 0x00,
+};
+
+static const struct {
+  const uint8_t *data;
+  size_t size;
+} SEEDS[] = {
+    {SEED_STORE_PAST_TOP, sizeof(SEED_STORE_PAST_TOP)},
+    {SEED_STORE_WRAPS, sizeof(SEED_STORE_WRAPS)},
+    {SEED_FONT_PRIVATE_PAGE, sizeof(SEED_FONT_PRIVATE_PAGE)},
+};
+#define SEED_COUNT (int)(sizeof(SEEDS) / sizeof(SEEDS[0]))
+
+static uint32_t rng = 1;
+
+static uint32_t next_random() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// inputs longer than MEM_SIZE are cut, the ROM part couldn't be loaded anyway
+static uint8_t *read_input(const char *file_name, size_t *size) {
+  FILE *file = fopen(file_name, "rb");
+  if (!file) {
+    fprintf(stderr, "open input error: %s\n", file_name);
+    return NULL;
+  }
+  uint8_t *data = malloc(MEM_SIZE);
+  if (!data) {
+    fclose(file);
+    return NULL;
+  }
+  *size = fread(data, 1, MEM_SIZE, file);
+  fclose(file);
+  return data;
+}
+
+/**
+ * Next generated input: a file from the corpus or a seed with a few bytes
+ * changed, or random bytes
+ */
+static size_t mutate(uint8_t **corpus, size_t *sizes, int count,
+                     uint8_t *input) {
+  size_t size;
+  int pick = next_random() % (count + SEED_COUNT + 1);
+  if (pick < count) {
+    size = sizes[pick];
+    memcpy(input, corpus[pick], size);
+  } else if (pick < count + SEED_COUNT) {
+    size = SEEDS[pick - count].size;
+    memcpy(input, SEEDS[pick - count].data, size);
+  } else {
+    size = FUZZ_HEADER + next_random() % (FUZZ_ROM_MAX + 1);
+    for (size_t i = 0; i < size; i++) {
+      input[i] = next_random();
+    }
+  }
+  if (!size) {
+    return 0;
+  }
+  for (int changes = 1 + next_random() % 8; changes; changes--) {
+    input[next_random() % size] = next_random();
+  }
+  return size;
+}
+
+static void usage() {
+  printf("usage: ./chip8-fuzz [-r runs] [-S seed] [input]...\n");
+  printf(
+      "  runs the built-in seeds and every input once, then `runs` inputs "
+      "mutated from them or random\n");
+}
+
+int main(int argc, char *const argv[]) {
+  uint64_t runs = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:S:h")) != -1) {
+    switch (opt) {
+      case 'r':
+        runs = strtoull(optarg, NULL, 10);
+        break;
+      case 'S':
+        rng = strtoul(optarg, NULL, 10) | 1;
+        break;
+      default:
+        usage();
+        return -1;
+    }
+  }
+  int count = argc - optind;
+  uint8_t **corpus = calloc(count + 1, sizeof(uint8_t *));
+  size_t *sizes = calloc(count + 1, sizeof(size_t));
+  uint8_t *input = malloc(MEM_SIZE);
+  if (!corpus || !sizes || !input) {
+    return -1;
+  }
+  for (int i = 0; i < SEED_COUNT; i++) {
+    LLVMFuzzerTestOneInput(SEEDS[i].data, SEEDS[i].size);
+  }
+  for (int i = 0; i < count; i++) {
+    if (!(corpus[i] = read_input(argv[optind + i], &sizes[i]))) {
+      return -1;
+    }
+    LLVMFuzzerTestOneInput(corpus[i], sizes[i]);
+  }
+  for (uint64_t run = 0; run < runs; run++) {
+    size_t size = mutate(corpus, sizes, count, input);
+    LLVMFuzzerTestOneInput(input, size);
+  }
+  printf("%d seeds, %d inputs, %llu generated, no crash\n", SEED_COUNT, count,
+         (unsigned long long)runs);
+  for (int i = 0; i < count; i++) {
+    free(corpus[i]);
+  }
+  free(corpus);
+  free(sizes);
+  free(input);
+  jit_free(jit);
+  return 0;
+}
+
+#endif  // CHIP8_LIBFUZZER
@@ -0,0 +1,186 @@
+#include "headless.h"
+
+#include <time.h>
+
+#include "jit.h"
+
+/**
+ * @brief monotonic wall clock
+ * @retval seconds since an unspecified starting point
+ */
+double headless_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief number of instructions in a given 60 Hz frame
+ * @note frequency / 60 rounded so that any 60 consecutive frames run exactly
+ * `frequency` instructions, every frontend splits frames this way so runs
+ * line up cycle for cycle
+ * @param  frequency: emulated CPU frequency
+ * @param  frame: index of the frame since the start of the run
+ * @retval instructions to run before the frame's timer tick
+ */
+uint32_t headless_frame_cycles(int frequency, uint64_t frame) {
+  return (uint64_t)frequency * (frame + 1) / 60 -
+         (uint64_t)frequency * frame / 60;
+}
+
+/**
+ * @brief run the instructions of one 60 Hz frame, without the timer tick
+ * @note frequency/60 instructions, skipped when spent in an idle loop, or a
+ * frame of the VIP clock with QUIRK_VIP_CLOCK
+ * @param  *chip8: instance with a ROM loaded
+ * @param  frequency: emulated CPU frequency
+ * @param  frame: frames run so far
+ * @retval instructions (VIP machine cycles) run
+ */
+uint32_t headless_run_frame(CHIP8 *chip8, int frequency, uint64_t frame) {
+  if (chip8->image->quirks & QUIRK_VIP_CLOCK) {
+    return chip8_run_vip(chip8, UINT32_MAX);
+  }
+  uint32_t cycles = headless_frame_cycles(frequency, frame);
+  if (!chip8_skip_idle(chip8, cycles)) {
+    chip8_run(chip8, cycles);
+  }
+  return cycles;
+}
+
+/**
+ * @brief run the core as fast as the host allows, no display and no sleep
+ * @note timers tick after every frame of headless_frame_cycles() instructions,
+ * so the program sees the same 60 Hz timers it would see in real time. With
+ * QUIRK_VIP_CLOCK a frame is VIP_FRAME_CYCLES of chip8_run_vip() instead, run
+ * by the interpreter whatever the backend
+ * @param  *chip8: instance with a ROM loaded
+ * @param  cycles: most instructions to execute
+ * @param  max_frames: most frames to run, 0 for no limit
+ * @param  frequency: emulated CPU frequency, only used to pace the timers
+ * @param  backend: interpreter or recompiler, the recompiler falls back to
+ * the interpreter when the host can't run it
+ * @param  *capture: gets every frame, may be NULL
+ * @param  *stats: filled with the run statistics, may be NULL
+ * @retval None
+ */
+void chip8_run_headless(CHIP8 *chip8, uint64_t cycles, uint64_t max_frames,
+                        int frequency, enum backend backend,
+                        CAPTURE *capture, HEADLESS_STATS *stats) {
+  uint8_t vip_clock = (chip8->image->quirks & QUIRK_VIP_CLOCK) != 0;
+  CHIP8_JIT *jit = NULL;
+  if (backend == BACKEND_JIT && !vip_clock && !(jit = jit_init())) {
+    fprintf(stderr, "jit unavailable, using the interpreter\n");
+  }
+  // frames of the fixed clock are a known number of instructions
+  if (max_frames && !vip_clock) {
+    uint64_t frame_cycles = (uint64_t)frequency * max_frames / 60;
+    cycles = cycles < frame_cycles ? cycles : frame_cycles;
+  }
+  uint64_t done = 0;
+  uint64_t frames = 0;
+  // instructions the recompiler ran ahead of the current frame
+  uint64_t ahead = 0;
+  // pc at the start of the previous frame, idle loops keep it within a few
+  // instructions so only then is chip8_skip_idle() worth calling
+  uint16_t last_pc = chip8->pc + 0x100;
+  double start = headless_seconds();
+  while (done < cycles && (!max_frames || frames < max_frames) &&
+         chip8->state != SYS_QUIT) {
+    uint64_t per_frame = headless_frame_cycles(frequency, frames);
+    uint64_t burst = cycles - done < per_frame ? cycles - done : per_frame;
+    uint16_t pc = chip8->pc;
+    uint8_t maybe_idle = (uint16_t)(pc - last_pc + 4) <= 8;
+    last_pc = pc;
+    uint8_t frame_over;
+    if (vip_clock) {
+      uint64_t left = cycles - done;
+      burst = chip8_run_vip(chip8, left < UINT32_MAX ? left : UINT32_MAX);
+      frame_over = chip8->vip_clock >= VIP_FRAME_CYCLES;
+    } else if (!ahead && maybe_idle && chip8_skip_idle(chip8, burst)) {
+      // idle until the timer tick, nothing to run
+      frame_over = burst == per_frame;
+    } else if (jit) {
+      // only the last bursts must stop on the exact instruction
+      uint8_t exact = cycles - done - burst < JIT_BLOCK_MAX;
+      if (ahead < burst) {
+        ahead += jit_run(jit, chip8, burst - ahead, exact);
+      }
+      ahead -= burst;
+      frame_over = burst == per_frame;
+    } else {
+      chip8_run(chip8, burst);
+      frame_over = burst == per_frame;
+    }
+    done += burst;
+    if (frame_over) {
+      chip8_timer(chip8);
+      capture_frame(capture, chip8);
+      frames++;
+    }
+  }
+  double seconds = headless_seconds() - start;
+  jit_free(jit);
+  if (stats) {
+    stats->cycles = done;
+    stats->frames = frames;
+    stats->seconds = seconds;
+    stats->ips = seconds > 0 ? done / seconds : 0;
+  }
+}
+
+/**
+ * @brief write registers and framebuffer as text, stable across runs so two
+ * dumps can be diffed
+ * @param  *chip8: instance to dump
+ * @param  *out: output stream
+ * @retval None
+ */
+void chip8_dump_state(CHIP8 *chip8, FILE *out) {
+  for (int i = 0; i < 16; i++) {
+    fprintf(out, "V%X=%02X%c", i, chip8->reg[i], i == 15 ? '\n' : ' ');
+  }
+  fprintf(out, "I=%04X PC=%04X SP=%02X DT=%02X ST=%02X\n", chip8->index_reg,
+          chip8->pc, chip8->sp, chip8->delay_timer, chip8->sound_timer);
+  fprintf(out, "STACK=");
+  for (int i = 0; i < chip8->sp && i < 16; i++) {
+    fprintf(out, "%04X ", chip8->stack[i]);
+  }
+  fprintf(out, "\n");
+  for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+    for (int x = 0; x < DISPLAY_WIDTH; x++) {
+      fputc(".#+@"[DISPLAY_COLOR(chip8->display, x, y)], out);
+    }
+    fputc('\n', out);
+  }
+}
+
+/**
+ * @brief print run statistics
+ * @param  *stats: statistics from chip8_run_headless
+ * @param  *out: output stream
+ * @retval None
+ */
+void headless_print_stats(HEADLESS_STATS *stats, FILE *out) {
+  fprintf(out,
+          "cycles=%llu frames=%llu seconds=%.6f ips=%.0f ns/inst=%.2f\n",
+          (unsigned long long)stats->cycles, (unsigned long long)stats->frames,
+          stats->seconds, stats->ips,
+          stats->cycles ? stats->seconds * 1e9 / stats->cycles : 0.0);
+}
+
+/**
+ * @brief FNV-1a hash of the framebuffer, equal frames give equal hashes
+ * @param  *chip8: instance to hash
+ * @retval 64-bit hash
+ */
+uint64_t headless_display_hash(CHIP8 *chip8) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (int y = 0; y < DISPLAY_PLANES * DISPLAY_HEIGHT; y++) {
+    for (int i = 0; i < DISPLAY_WIDTH / 8; i++) {
+      hash ^= (uint8_t)(chip8->display[y] >> (DISPLAY_WIDTH - 8 - 8 * i));
+      hash *= 0x100000001B3ULL;
+    }
+  }
+  return hash;
+}
@@ -0,0 +1,35 @@
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "capture.h"
+#include "chip8.h"
+
+enum backend { BACKEND_INTERP, BACKEND_JIT };
+
+typedef struct headless_stats {
+  uint64_t cycles;  // instructions executed
+  uint64_t frames;  // 60 Hz timer ticks
+  double seconds;   // wall time spent running
+  double ips;       // instructions per second
+} HEADLESS_STATS;
+
+double headless_seconds();
+
+uint32_t headless_frame_cycles(int frequency, uint64_t frame);
+
+uint32_t headless_run_frame(CHIP8 *chip8, int frequency, uint64_t frame);
+
+void chip8_run_headless(CHIP8 *chip8, uint64_t cycles, uint64_t max_frames,
+                        int frequency, enum backend backend,
+                        CAPTURE *capture, HEADLESS_STATS *stats);
+
+void chip8_dump_state(CHIP8 *chip8, FILE *out);
+
+void headless_print_stats(HEADLESS_STATS *stats, FILE *out);
+
+uint64_t headless_display_hash(CHIP8 *chip8);
+
+#endif  //__HEADLESS_H__
@@ -0,0 +1,571 @@
+#include "jit.h"
+
+#include <stddef.h>
+
+/**
+ * Dynamic recompiler for x86-64.
+ *
+ * A block is a straight-line run of register-only instructions (6XNN, 7XNN,
+ * 8XYN, ANNN, FX1E, FX29) starting at some address. The V
+ * registers and I used by the block live in host registers while it runs and
+ * are written back on exit, together with the PC of the first instruction
+ * the block doesn't cover. That instruction (a jump, call, skip, draw, memory
+ * store...) is then executed by the interpreter.
+ *
+ * Blocks never touch timers, keys, the display or memory, so running one past
+ * the end of a frame is invisible to the program as long as the timers tick
+ * after it. jit_run() takes advantage of that and may overshoot its budget,
+ * returning how many instructions it actually ran.
+ *
+ * The code buffer is never writable and executable at once: it is mapped
+ * read-write while blocks are emitted and read-execute while they run, a
+ * hostile ROM can't get the host to execute bytes it has just written.
+ *
+ * Quirks are resolved while translating, like the interpreter does when it
+ * decodes. A JIT caches code translated from one instance's memory with that
+ * instance's quirks, so it must only be used with that instance.
+ */
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+
+#define CODE_SIZE (1 << 20)
+// largest block is well under 1 KB, flush the cache when less is left
+#define CODE_RESERVE 2048
+// shorter runs are cheaper to interpret than to enter and leave a block for
+#define BLOCK_MIN 4
+
+typedef void (*block_func)(CHIP8 *chip8);
+
+typedef struct jit_block {
+  block_func code;  // NULL if the run is too short to be worth translating
+  uint16_t end;     // address right after the block
+  uint8_t count;    // number of instructions translated
+  uint8_t compiled;
+} JIT_BLOCK;
+
+struct chip8_jit {
+  uint8_t *code;
+  size_t used;
+  uint8_t writable;  // code is mapped read-write, otherwise read-execute
+  JIT_BLOCK blocks[MEM_SIZE];
+};
+
+// host registers, in x86 encoding order
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11 };
+
+// caller-saved registers available to hold V0-VF, RAX is scratch, RBX holds I
+// and RDI the CHIP8 pointer
+static const uint8_t REG_POOL[] = {RCX, RDX, RSI, R8, R9, R10, R11};
+#define POOL_SIZE (sizeof(REG_POOL) / sizeof(REG_POOL[0]))
+
+typedef struct emitter {
+  uint8_t *p;
+  int8_t host[16];  // host register of each V register, -1 if unused
+  uint8_t used;
+  uint8_t uses_i;
+  uint32_t quirks;
+} EMITTER;
+
+static void emit8(EMITTER *e, uint8_t b) { *e->p++ = b; }
+
+static void emit16(EMITTER *e, uint16_t v) {
+  emit8(e, v & 0xFF);
+  emit8(e, v >> 8);
+}
+
+static void emit32(EMITTER *e, uint32_t v) {
+  emit16(e, v & 0xFFFF);
+  emit16(e, v >> 16);
+}
+
+/**
+ * REX prefix, always emitted for byte operations so that SIL is addressable
+ */
+static void emit_rex(EMITTER *e, int reg, int rm) {
+  emit8(e, 0x40 | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+}
+
+/**
+ * `op r/m8, r8` between two registers
+ */
+static void emit_rr8(EMITTER *e, uint8_t op, int rm, int reg) {
+  emit_rex(e, reg, rm);
+  emit8(e, op);
+  emit8(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/**
+ * `op reg, [rdi + disp32]` (or the store direction depending on op)
+ */
+static void emit_mem(EMITTER *e, int prefix, uint8_t op, int reg,
+                     size_t disp) {
+  if (prefix) {
+    emit8(e, prefix);
+  }
+  emit_rex(e, reg, RDI);
+  emit8(e, op);
+  emit8(e, 0x80 | (reg & 7) << 3 | RDI);
+  emit32(e, disp);
+}
+
+static void emit_movzx_mem(EMITTER *e, uint8_t op, int reg, size_t disp) {
+  emit_rex(e, reg, RDI);
+  emit8(e, 0x0F);
+  emit8(e, op);
+  emit8(e, 0x80 | (reg & 7) << 3 | RDI);
+  emit32(e, disp);
+}
+
+static int is_simple(uint16_t opcode) {
+  switch ((opcode & 0xF000) >> 12) {
+    case 0x6:
+    case 0x7:
+    case 0xA:
+      return 1;
+    case 0x8:
+      switch (N(opcode)) {
+        case 0x0:
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x6:
+        case 0x7:
+        case 0xE:
+          return 1;
+      }
+      return 0;
+    case 0xF:
+      return NN(opcode) == 0x1E || NN(opcode) == 0x29;
+  }
+  return 0;
+}
+
+/**
+ * Allocate the V registers an instruction touches, 0 when the pool is full
+ */
+static int alloc_regs(EMITTER *e, uint16_t opcode) {
+  uint8_t want[3];
+  int n = 0;
+  switch ((opcode & 0xF000) >> 12) {
+    case 0x8:
+      want[n++] = X(opcode);
+      want[n++] = Y(opcode);
+      if (N(opcode) >= 0x4 ||
+          (N(opcode) >= 0x1 && (e->quirks & QUIRK_VF_RESET))) {
+        want[n++] = 0xF;
+      }
+      break;
+    case 0xA:
+      e->uses_i = 1;
+      return 1;
+    case 0xF:
+      if (NN(opcode) == 0x1E || NN(opcode) == 0x29) {
+        e->uses_i = 1;
+      }
+      // fall through
+    default:
+      want[n++] = X(opcode);
+      break;
+  }
+  uint16_t missing = 0;
+  for (int i = 0; i < n; i++) {
+    if (e->host[want[i]] < 0) {
+      missing |= 1 << want[i];
+    }
+  }
+  if (e->used + __builtin_popcount(missing) > (int)POOL_SIZE) {
+    return 0;
+  }
+  for (int i = 0; i < n; i++) {
+    if (e->host[want[i]] < 0) {
+      e->host[want[i]] = REG_POOL[e->used++];
+    }
+  }
+  return 1;
+}
+
+/**
+ * `mov vf, 0`, 8XY1/8XY2/8XY3 with QUIRK_VF_RESET
+ */
+static void emit_vf_reset(EMITTER *e, int vf) {
+  if (e->quirks & QUIRK_VF_RESET) {
+    emit_rex(e, 0, vf);
+    emit8(e, 0xB0 | (vf & 7));
+    emit8(e, 0);
+  }
+}
+
+/**
+ * Emit one instruction, in the same order of reads and writes as its
+ * interpreter handler so that VF aliasing VX or VY behaves the same
+ */
+static void emit_inst(EMITTER *e, uint16_t opcode) {
+  int vx = e->host[X(opcode)];
+  int vy = e->host[Y(opcode)];
+  int vf = e->host[0xF];
+  switch ((opcode & 0xF000) >> 12) {
+    case 0x6:
+      // mov vx, imm8
+      emit_rex(e, 0, vx);
+      emit8(e, 0xB0 | (vx & 7));
+      emit8(e, NN(opcode));
+      break;
+    case 0x7:
+      // add vx, imm8
+      emit_rex(e, 0, vx);
+      emit8(e, 0x80);
+      emit8(e, 0xC0 | (vx & 7));
+      emit8(e, NN(opcode));
+      break;
+    case 0xA:
+      // mov ebx, imm32
+      emit8(e, 0xB8 | RBX);
+      emit32(e, NNN(opcode));
+      break;
+    case 0x8:
+      switch (N(opcode)) {
+        case 0x0:
+          emit_rr8(e, 0x88, vx, vy);
+          break;
+        case 0x1:
+          emit_rr8(e, 0x08, vx, vy);
+          emit_vf_reset(e, vf);
+          break;
+        case 0x2:
+          emit_rr8(e, 0x20, vx, vy);
+          emit_vf_reset(e, vf);
+          break;
+        case 0x3:
+          emit_rr8(e, 0x30, vx, vy);
+          emit_vf_reset(e, vf);
+          break;
+        case 0x4:
+          // add vx, vy; setc vf
+          emit_rr8(e, 0x00, vx, vy);
+          emit_rex(e, 0, vf);
+          emit16(e, 0x920F);
+          emit8(e, 0xC0 | (vf & 7));
+          break;
+        case 0x5:
+          // cmp vx, vy; seta al; mov vf, al; sub vx, vy
+          emit_rr8(e, 0x38, vx, vy);
+          emit16(e, 0x970F);
+          emit8(e, 0xC0);
+          emit_rr8(e, 0x88, vf, RAX);
+          emit_rr8(e, 0x28, vx, vy);
+          break;
+        case 0x6:
+          if (e->quirks & QUIRK_SHIFT_VY) {
+            // mov al, vy; and al, 1; mov vx, vy; shr vx, 1; mov vf, al
+            emit_rr8(e, 0x88, RAX, vy);
+            emit16(e, 0x0124);
+            emit_rr8(e, 0x88, vx, vy);
+            emit_rex(e, 0, vx);
+            emit8(e, 0xD0);
+            emit8(e, 0xE8 | (vx & 7));
+            emit_rr8(e, 0x88, vf, RAX);
+            break;
+          }
+          // mov al, vx; and al, 1; mov vf, al; shr vx, 1
+          emit_rr8(e, 0x88, RAX, vx);
+          emit16(e, 0x0124);
+          emit_rr8(e, 0x88, vf, RAX);
+          emit_rex(e, 0, vx);
+          emit8(e, 0xD0);
+          emit8(e, 0xE8 | (vx & 7));
+          break;
+        case 0x7:
+          // cmp vx, vy; setb al; mov vf, al; mov al, vy; sub al, vx;
+          // mov vx, al
+          emit_rr8(e, 0x38, vx, vy);
+          emit16(e, 0x920F);
+          emit8(e, 0xC0);
+          emit_rr8(e, 0x88, vf, RAX);
+          emit_rr8(e, 0x88, RAX, vy);
+          emit_rr8(e, 0x28, RAX, vx);
+          emit_rr8(e, 0x88, vx, RAX);
+          break;
+        case 0xE:
+          if (e->quirks & QUIRK_SHIFT_VY) {
+            // mov al, vy; shr al, 7; mov vx, vy; shl vx, 1; mov vf, al
+            emit_rr8(e, 0x88, RAX, vy);
+            emit8(e, 0xC0);
+            emit16(e, 0x07E8);
+            emit_rr8(e, 0x88, vx, vy);
+            emit_rex(e, 0, vx);
+            emit8(e, 0xD0);
+            emit8(e, 0xE0 | (vx & 7));
+            emit_rr8(e, 0x88, vf, RAX);
+            break;
+          }
+          // the interpreter stores VX itself in VF: mov vf, vx; shl vx, 1
+          emit_rr8(e, 0x88, vf, vx);
+          emit_rex(e, 0, vx);
+          emit8(e, 0xD0);
+          emit8(e, 0xE0 | (vx & 7));
+          break;
+      }
+      break;
+    case 0xF:
+      switch (NN(opcode)) {
+        case 0x1E:
+          // movzx eax, vx; add bx, ax
+          emit_rex(e, RAX, vx);
+          emit16(e, 0xB60F);
+          emit8(e, 0xC0 | (vx & 7));
+          emit8(e, 0x66);
+          emit16(e, 0xC301);
+          break;
+        case 0x29:
+          // the byte read goes up to FONTSET_MEM_START + 5 * 255, across
+          // several MEM_PAGE_SIZE (256) pages that each may be private, so
+          // look its page up like MEM_READ() does. I is overwritten, RBX is
+          // free until then:
+          // movzx eax, vx; lea eax, [rax + rax * 4];
+          // add eax, FONTSET_MEM_START; mov ebx, eax; shr ebx, 8;
+          // mov rbx, [rdi + rbx * 8 + pages]; movzx eax, al;
+          // movzx ebx, byte [rbx + rax]
+          emit_rex(e, RAX, vx);
+          emit16(e, 0xB60F);
+          emit8(e, 0xC0 | (vx & 7));
+          emit8(e, 0x8D);
+          emit16(e, 0x8004);
+          emit8(e, 0x05);
+          emit32(e, FONTSET_MEM_START);
+          emit16(e, 0xC389);
+          emit16(e, 0xEBC1);
+          emit8(e, 8);
+          emit8(e, 0x48);
+          emit16(e, 0x9C8B);
+          emit8(e, 0xDF);
+          emit32(e, offsetof(CHIP8, pages));
+          emit16(e, 0xB60F);
+          emit8(e, 0xC0);
+          emit16(e, 0xB60F);
+          emit16(e, 0x031C);
+          break;
+      }
+      break;
+  }
+}
+
+/**
+ * Map the code buffer for emitting or for running, 0 if mprotect() failed
+ */
+static uint8_t code_protect(CHIP8_JIT *jit, uint8_t writable) {
+  if (jit->writable == writable) {
+    return 1;
+  }
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+  if (mprotect(jit->code, CODE_SIZE, prot)) {
+    return 0;
+  }
+  jit->writable = writable;
+  return 1;
+}
+
+static uint16_t fetch(CHIP8 *chip8, uint16_t addr) {
+  return MEM_READ(chip8, addr) << 8 | MEM_READ(chip8, addr + 1);
+}
+
+static void compile(CHIP8_JIT *jit, CHIP8 *chip8, uint16_t start) {
+  JIT_BLOCK *block = &jit->blocks[start];
+  EMITTER e;
+  memset(e.host, -1, sizeof(e.host));
+  e.used = 0;
+  e.uses_i = 0;
+  e.quirks = chip8->image->quirks;
+
+  // 1. find the block end and allocate registers
+  uint16_t addr = start;
+  uint8_t count = 0;
+  while (count < JIT_BLOCK_MAX && addr + 1 < MEM_SIZE) {
+    uint16_t opcode = fetch(chip8, addr);
+    if (!is_simple(opcode) || !alloc_regs(&e, opcode)) {
+      break;
+    }
+    addr += 2;
+    count++;
+  }
+  block->compiled = 1;
+  block->count = count;
+  block->end = addr;
+  block->code = NULL;
+  // the run is left to the interpreter when the code can't be written
+  if (count < BLOCK_MIN || !code_protect(jit, 1)) {
+    return;
+  }
+  if (jit->used + CODE_RESERVE > CODE_SIZE) {
+    jit_flush(jit);
+    block->compiled = 1;
+    block->count = count;
+    block->end = addr;
+  }
+
+  // 2. prologue: load state into host registers
+  e.p = jit->code + jit->used;
+  uint8_t *entry = e.p;
+  if (e.uses_i) {
+    emit8(&e, 0x50 | RBX);  // push rbx
+    emit_movzx_mem(&e, 0xB7, RBX, offsetof(CHIP8, index_reg));
+  }
+  for (int i = 0; i < 16; i++) {
+    if (e.host[i] >= 0) {
+      emit_mem(&e, 0, 0x8A, e.host[i], offsetof(CHIP8, reg) + i);
+    }
+  }
+  // 3. body
+  for (uint16_t pc = start; pc < addr; pc += 2) {
+    emit_inst(&e, fetch(chip8, pc));
+  }
+  // 4. epilogue: write back and leave PC on the next instruction
+  for (int i = 0; i < 16; i++) {
+    if (e.host[i] >= 0) {
+      emit_mem(&e, 0, 0x88, e.host[i], offsetof(CHIP8, reg) + i);
+    }
+  }
+  if (e.uses_i) {
+    emit_mem(&e, 0x66, 0x89, RBX, offsetof(CHIP8, index_reg));
+    emit8(&e, 0x58 | RBX);  // pop rbx
+  }
+  emit_mem(&e, 0x66, 0xC7, RAX, offsetof(CHIP8, pc));
+  emit16(&e, addr);
+  emit8(&e, 0xC3);  // ret
+
+  block->code = (block_func)entry;
+  jit->used = e.p - jit->code;
+}
+
+/**
+ * @brief create a recompiler
+ * @retval NULL if the host can't run generated code
+ */
+CHIP8_JIT *jit_init() {
+  CHIP8_JIT *jit = malloc(sizeof(CHIP8_JIT));
+  if (!jit) {
+    return NULL;
+  }
+  jit->code = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (jit->code == MAP_FAILED) {
+    free(jit);
+    return NULL;
+  }
+  jit->writable = 1;
+  jit_flush(jit);
+  return jit;
+}
+
+void jit_free(CHIP8_JIT *jit) {
+  if (!jit) {
+    return;
+  }
+  munmap(jit->code, CODE_SIZE);
+  free(jit);
+}
+
+/**
+ * @brief drop every translated block
+ */
+void jit_flush(CHIP8_JIT *jit) {
+  memset(jit->blocks, 0, sizeof(jit->blocks));
+  jit->used = 0;
+}
+
+/**
+ * Drop the blocks translated from [addr, addr + len), within memory
+ */
+static void invalidate_range(CHIP8_JIT *jit, int addr, int len) {
+  int first = addr - 2 * JIT_BLOCK_MAX - 1;
+  int last = addr + len;
+  for (int i = first < 0 ? 0 : first; i < last; i++) {
+    JIT_BLOCK *block = &jit->blocks[i];
+    // the block was built from the bytes [i, end + 2)
+    if (block->compiled && block->end + 2 > addr) {
+      block->compiled = 0;
+      block->code = NULL;
+    }
+  }
+}
+
+/**
+ * @brief drop the blocks translated from [addr, addr + len)
+ * @note the range wraps around at MEM_SIZE like chip8_write() does, I past
+ * the top of memory stores at I & (MEM_SIZE - 1)
+ */
+void jit_invalidate(CHIP8_JIT *jit, uint16_t addr, uint16_t len) {
+  int start = addr & (MEM_SIZE - 1);
+  if (start + len > MEM_SIZE) {
+    // blocks never cross the top of memory, each part is dropped on its own
+    invalidate_range(jit, start, MEM_SIZE - start);
+    invalidate_range(jit, 0, start + len - MEM_SIZE);
+  } else {
+    invalidate_range(jit, start, len);
+  }
+}
+
+/**
+ * @brief execute `cycles` instructions, translated blocks where possible and
+ * the interpreter for everything else
+ * @param  exact: stop at exactly `cycles` instructions, otherwise the last
+ * block may run up to JIT_BLOCK_MAX - 1 instructions further
+ * @retval number of instructions executed
+ */
+uint32_t jit_run(CHIP8_JIT *jit, CHIP8 *chip8, uint32_t cycles,
+                 uint8_t exact) {
+  uint32_t done = 0;
+  while (done < cycles) {
+    uint16_t pc = chip8->pc;
+    if (pc < MEM_SIZE) {
+      JIT_BLOCK *block = &jit->blocks[pc];
+      if (!block->compiled) {
+        compile(jit, chip8, pc);
+      }
+      if (block->code && (!exact || done + block->count <= cycles) &&
+          code_protect(jit, 0)) {
+        block->code(chip8);
+        done += block->count;
+        continue;
+      }
+    }
+    // interpreter fallback, watch for stores into translated code
+    uint16_t opcode = MEM_READ(chip8, pc) << 8 | MEM_READ(chip8, pc + 1);
+    uint16_t index = chip8->index_reg;
+    chip8_run(chip8, 1);
+    done++;
+    if ((opcode & 0xF0FF) == 0xF055) {
+      jit_invalidate(jit, index, X(opcode) + 1);
+    } else if ((opcode & 0xF0FF) == 0xF033) {
+      jit_invalidate(jit, index, 3);
+    }
+#if CHIP8_VARIANT == CHIP8_XO
+    else if ((opcode & 0xF00F) == 0x5002) {
+      jit_invalidate(jit, index, abs(X(opcode) - Y(opcode)) + 1);
+    }
+#endif
+  }
+  return done;
+}
+
+#else
+
+// no recompiler on this host, callers fall back to the interpreter
+CHIP8_JIT *jit_init() { return NULL; }
+
+void jit_free(CHIP8_JIT *jit) {}
+
+uint32_t jit_run(CHIP8_JIT *jit, CHIP8 *chip8, uint32_t cycles,
+                 uint8_t exact) {
+  chip8_run(chip8, cycles);
+  return cycles;
+}
+
+void jit_invalidate(CHIP8_JIT *jit, uint16_t addr, uint16_t len) {}
+
+void jit_flush(CHIP8_JIT *jit) {}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+// longest run of instructions translated into one block
+#define JIT_BLOCK_MAX 64
+
+typedef struct chip8_jit CHIP8_JIT;
+
+CHIP8_JIT *jit_init();
+
+void jit_free(CHIP8_JIT *jit);
+
+uint32_t jit_run(CHIP8_JIT *jit, CHIP8 *chip8, uint32_t cycles,
+                 uint8_t exact);
+
+void jit_invalidate(CHIP8_JIT *jit, uint16_t addr, uint16_t len);
+
+void jit_flush(CHIP8_JIT *jit);
+
+#endif  //__JIT_H__
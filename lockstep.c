@@ -0,0 +1,484 @@
+/**
+ * Lockstep differential runner: a reference core stepping with chip8_cycle()
+ * and a candidate core on a fast path run side by side from the same state and
+ * the same input.
+ *
+ * The cores are compared every `interval` instructions and at every timer tick
+ * and key change. On a mismatch the stretch since the last comparison that
+ * matched is replayed from its starting state, with a cold candidate, to find
+ * the first instruction whose result differs. The replay start is then moved
+ * up to that instruction for as long as the mismatch still reproduces, and the
+ * state there is written as a savestate: `chip8-lockstep -l <state> -c <n>`
+ * runs just the failing instructions again. A recompiled block only runs as a
+ * whole, a mismatch inside one shows at its last instruction.
+ */
+#include <unistd.h>
+
+#include "chip8.h"
+#include "headless.h"
+#include "jit.h"
+#include "movie.h"
+#include "savestate.h"
+#ifdef CHIP8_AOT
+#include "aot.h"
+#endif
+
+typedef struct lockstep_field {
+  const char *name;
+  size_t offset;
+  size_t size;
+  size_t element;  // size of one entry, printed when at most 4 bytes
+} LOCKSTEP_FIELD;
+
+#define FIELD(name, element) \
+  {#name, offsetof(CHIP8, name), sizeof(((CHIP8 *)0)->name), element}
+
+// compared state besides memory, opcode is left out: only chip8_cycle() keeps
+// it up to date
+static const LOCKSTEP_FIELD FIELDS[] = {
+    FIELD(reg, 1),         FIELD(index_reg, 2),
+    FIELD(pc, 2),          FIELD(sp, 1),
+    FIELD(stack, 2),       FIELD(delay_timer, 1),
+    FIELD(sound_timer, 1), FIELD(display, sizeof(DISPLAY_ROW)),
+    FIELD(keys, 1),
+#if CHIP8_VARIANT != CHIP8_CLASSIC
+    FIELD(hires, 1),       FIELD(flags, 1),
+#endif
+#if CHIP8_VARIANT == CHIP8_XO
+    FIELD(planes, 1),      FIELD(pitch, 1),
+    FIELD(pattern, 1),
+#endif
+    FIELD(vip_clock, 2),   FIELD(rng, 4),
+};
+
+#define FIELD_COUNT (sizeof(FIELDS) / sizeof(FIELDS[0]))
+
+typedef struct lockstep {
+  CHIP8 *reference;
+  CHIP8 *candidate;
+  CHIP8_JIT *jit;      // candidate runs the recompiler, NULL to interpret
+  uint8_t skip_idle;   // candidate fast-forwards idle loops
+  uint32_t interval;   // instructions between two comparisons at most
+  uint64_t cycle;      // instructions both cores ran and agreed on
+  uint64_t compares;
+  CHIP8_SNAPSHOT *start;  // both cores at the last comparison that matched
+  CHIP8_SNAPSHOT *probe;  // scratch state of the replays
+  const char *repro_name;
+} LOCKSTEP;
+
+static uint32_t field_value(const CHIP8 *chip8, const LOCKSTEP_FIELD *field,
+                            size_t i) {
+  const uint8_t *p =
+      (const uint8_t *)chip8 + field->offset + i * field->element;
+  uint16_t u16;
+  uint32_t u32;
+  switch (field->element) {
+    case 1:
+      return *p;
+    case 2:
+      memcpy(&u16, p, 2);
+      return u16;
+    case 4:
+      memcpy(&u32, p, 4);
+      return u32;
+  }
+  return 0;
+}
+
+/**
+ * Number of compared fields that differ, each printed to `out` unless NULL
+ */
+static int differences(const CHIP8 *reference, const CHIP8 *candidate,
+                       FILE *out) {
+  int found = 0;
+  for (size_t f = 0; f < FIELD_COUNT; f++) {
+    const LOCKSTEP_FIELD *field = &FIELDS[f];
+    const uint8_t *a = (const uint8_t *)reference + field->offset;
+    const uint8_t *b = (const uint8_t *)candidate + field->offset;
+    if (!memcmp(a, b, field->size)) {
+      continue;
+    }
+    found++;
+    if (!out) {
+      continue;
+    }
+    size_t count = field->size / field->element;
+    for (size_t i = 0; i < count; i++) {
+      if (!memcmp(a + i * field->element, b + i * field->element,
+                  field->element)) {
+        continue;
+      }
+      // only the first differing entry of an array
+      if (count == 1) {
+        fprintf(out, "  %s: reference %X, candidate %X\n", field->name,
+                field_value(reference, field, i),
+                field_value(candidate, field, i));
+      } else if (field->element <= 4) {
+        fprintf(out, "  %s[0x%zX]: reference %X, candidate %X\n", field->name,
+                i, field_value(reference, field, i),
+                field_value(candidate, field, i));
+      } else {
+        fprintf(out, "  %s[%zu] differs\n", field->name, i);
+      }
+      break;
+    }
+  }
+  for (int page = 0; page < MEM_PAGES; page++) {
+    const uint8_t *a = reference->pages[page];
+    const uint8_t *b = candidate->pages[page];
+    if (!memcmp(a, b, MEM_PAGE_SIZE)) {
+      continue;
+    }
+    found++;
+    int i = 0;
+    while (a[i] == b[i]) {
+      i++;
+    }
+    if (out) {
+      fprintf(out, "  mem[0x%X]: reference %X, candidate %X\n",
+              page * MEM_PAGE_SIZE + i, a[i], b[i]);
+    }
+    break;
+  }
+  return found;
+}
+
+static void reference_run(CHIP8 *chip8, uint32_t cycles) {
+  while (cycles--) {
+    chip8_cycle(chip8);
+  }
+}
+
+/**
+ * The fast path under test, keys and timers stay as they are for `cycles`
+ */
+static void candidate_run(LOCKSTEP *lockstep, uint32_t cycles) {
+  CHIP8 *chip8 = lockstep->candidate;
+  if (lockstep->skip_idle && chip8_skip_idle(chip8, cycles)) {
+    return;
+  }
+  if (lockstep->jit) {
+    jit_run(lockstep->jit, chip8, cycles, 1);
+  } else {
+    chip8_run(chip8, cycles);
+  }
+}
+
+/**
+ * Put both cores in `state` with nothing cached: private pages decode again,
+ * no translated blocks, as if the state was just loaded
+ */
+static void restore(LOCKSTEP *lockstep, const CHIP8_SNAPSHOT *state) {
+  chip8_restore(lockstep->reference, state);
+  chip8_restore(lockstep->candidate, state);
+  chip8_invalidate(lockstep->reference, 0, MEM_SIZE);
+  chip8_invalidate(lockstep->candidate, 0, MEM_SIZE);
+  if (lockstep->jit) {
+    jit_flush(lockstep->jit);
+  }
+#ifdef CHIP8_AOT
+  aot_attach(lockstep->candidate);
+#endif
+}
+
+/**
+ * Replay the failing stretch: step the reference `from` instructions from the
+ * start, load that state into both cores and run both on to `to`
+ * @retval nonzero when the cores disagree at `to`
+ */
+static int replay(LOCKSTEP *lockstep, uint32_t from, uint32_t to) {
+  restore(lockstep, lockstep->start);
+  reference_run(lockstep->reference, from);
+  chip8_snapshot(lockstep->reference, lockstep->probe);
+  restore(lockstep, lockstep->probe);
+  reference_run(lockstep->reference, to - from);
+  candidate_run(lockstep, to - from);
+  return differences(lockstep->reference, lockstep->candidate, NULL);
+}
+
+/**
+ * Narrow a mismatch found after `cycles` instructions from the start state
+ * down to its first instruction and write the shortest replay that still
+ * reproduces it
+ */
+static void diverged(LOCKSTEP *lockstep, uint32_t cycles) {
+  unsigned long long first = lockstep->cycle;
+  printf("cores diverged between cycle %llu and %llu\n", first,
+         first + cycles);
+  differences(lockstep->reference, lockstep->candidate, stdout);
+
+  if (!replay(lockstep, 0, cycles)) {
+    // the candidate only fails with what it cached before the start
+    printf(
+        "a cold candidate matches from cycle %llu, the mismatch comes from "
+        "state cached earlier\n",
+        first);
+    restore(lockstep, lockstep->start);
+    if (chip8_save_state(lockstep->reference, lockstep->repro_name)) {
+      printf("state at cycle %llu written to %s\n", first,
+             lockstep->repro_name);
+    }
+    return;
+  }
+  // smallest prefix that diverges, a mismatch doesn't heal by itself
+  uint32_t low = 1, high = cycles;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (replay(lockstep, 0, mid)) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  uint32_t end = low;
+  // latest start that still reproduces, blocks may need a run-up
+  uint32_t from = end - 1;
+  while (from > 0 && !replay(lockstep, from, end)) {
+    from--;
+  }
+
+  restore(lockstep, lockstep->start);
+  reference_run(lockstep->reference, end - 1);
+  uint16_t pc = lockstep->reference->pc;
+  uint16_t opcode = MEM_READ(lockstep->reference, pc) << 8 |
+                    MEM_READ(lockstep->reference, pc + 1);
+  CHIP8_INST inst;
+  chip8_decode(opcode, lockstep->reference->image->quirks, &inst);
+  printf("first differing instruction: cycle %llu, pc %03X, opcode %04X (%s)\n",
+         first + end - 1, pc, opcode, chip8_handler_name(inst.func));
+
+  replay(lockstep, from, end);
+  differences(lockstep->reference, lockstep->candidate, stdout);
+  restore(lockstep, lockstep->start);
+  reference_run(lockstep->reference, from);
+  if (chip8_save_state(lockstep->reference, lockstep->repro_name)) {
+    printf("reproduce with: chip8-lockstep%s%s -q 0x%02X -l %s -c %u\n",
+           lockstep->jit ? " -J" : "", lockstep->skip_idle ? " -i" : "",
+           lockstep->reference->image->quirks, lockstep->repro_name,
+           end - from);
+  }
+}
+
+/**
+ * Run both cores `cycles` instructions on and compare them
+ * @retval 1 when they still agree
+ */
+static int lockstep_chunk(LOCKSTEP *lockstep, uint32_t cycles) {
+  chip8_snapshot(lockstep->reference, lockstep->start);
+  reference_run(lockstep->reference, cycles);
+  candidate_run(lockstep, cycles);
+  lockstep->compares++;
+  if (differences(lockstep->reference, lockstep->candidate, NULL)) {
+    diverged(lockstep, cycles);
+    return 0;
+  }
+  lockstep->cycle += cycles;
+  return 1;
+}
+
+static void set_keys(LOCKSTEP *lockstep, uint16_t mask) {
+  chip8_set_keys(lockstep->reference, mask);
+  chip8_set_keys(lockstep->candidate, mask);
+}
+
+/**
+ * Drive both cores frame by frame, with the timers ticking after every
+ * headless_frame_cycles() instructions and the keys of `movie`, if any
+ * @retval 1 when the cores agreed all along
+ */
+static int lockstep_run(LOCKSTEP *lockstep, MOVIE *movie, uint64_t cycles,
+                        int frequency) {
+  uint32_t next_event = 0;
+  uint32_t event_count = movie ? movie->header.event_count : 0;
+  for (uint64_t frame = 0; lockstep->cycle < cycles; frame++) {
+    uint64_t frame_end =
+        lockstep->cycle + headless_frame_cycles(frequency, frame);
+    uint8_t tick = frame_end <= cycles;
+    frame_end = tick ? frame_end : cycles;
+    while (lockstep->cycle < frame_end) {
+      while (next_event < event_count &&
+             movie->events[next_event].cycle <= lockstep->cycle) {
+        set_keys(lockstep, movie->events[next_event++].keys);
+      }
+      uint64_t until = lockstep->cycle + lockstep->interval;
+      until = until < frame_end ? until : frame_end;
+      if (next_event < event_count && movie->events[next_event].cycle < until) {
+        until = movie->events[next_event].cycle;
+      }
+      if (!lockstep_chunk(lockstep, until - lockstep->cycle)) {
+        return 0;
+      }
+      if (lockstep->reference->state == SYS_QUIT) {
+        return 1;
+      }
+    }
+    if (tick) {
+      chip8_timer(lockstep->reference);
+      chip8_timer(lockstep->candidate);
+    }
+  }
+  return 1;
+}
+
+static uint8_t load_rom(CHIP8 *chip8, const char *rom_name) {
+#ifdef CHIP8_AOT
+  if (strcmp(rom_name, "-") == 0) {
+    return chip8_load_bytes(chip8, aot_rom, aot_rom_size);
+  }
+#endif
+  return chip8_load_rom(chip8, rom_name);
+}
+
+/**
+ * Load the ROM and/or savestate into both cores and seed them alike
+ */
+static int prepare(LOCKSTEP *lockstep, const char *rom_name,
+                   const char *state_name, MOVIE *movie, uint32_t seed,
+                   uint16_t keys) {
+  // the candidate loads last, AOT builds run the translation for it
+  if (rom_name && (!load_rom(lockstep->reference, rom_name) ||
+                   !load_rom(lockstep->candidate, rom_name))) {
+    return 0;
+  }
+  if (movie && movie_rom_hash(lockstep->reference) != movie->header.rom_hash) {
+    printf("movie was recorded with another rom\n");
+    return 0;
+  }
+  chip8_seed(lockstep->reference, seed);
+  chip8_seed(lockstep->candidate, seed);
+  set_keys(lockstep, keys);
+  if (state_name && (!chip8_load_state(lockstep->reference, state_name) ||
+                     !chip8_load_state(lockstep->candidate, state_name))) {
+    return 0;
+  }
+#ifdef CHIP8_AOT
+  aot_attach(lockstep->candidate);
+#endif
+  return 1;
+}
+
+static void usage() {
+  printf(
+      "usage: ./chip8-lockstep [-J] [-i] [-n interval] [-c cycles] "
+      "[-f frequency] [-s seed] [-k mask] [-q quirks] [-m movie] "
+      "[-l savestate] [-o repro savestate] [rom]\n");
+  printf(
+      "  compares chip8_cycle() with chip8_run(), or the recompiler with -J, "
+      "-i adds idle loop skipping\n");
+#ifdef CHIP8_AOT
+  printf("  rom name `-` runs the built-in %s\n", aot_rom_name);
+#endif
+}
+
+int main(int argc, char *const argv[]) {
+  LOCKSTEP lockstep = {0};
+  lockstep.interval = 100;
+  lockstep.repro_name = "lockstep.state";
+  uint64_t cycles = 0;
+  int frequency = CYCLE_FREQUENCY;
+  uint32_t seed = 1;
+  uint16_t keys = 0;
+  const char *movie_name = NULL;
+  const char *state_name = NULL;
+  uint8_t use_jit = 0;
+#ifdef CHIP8_AOT
+  uint32_t quirks = aot_quirks;
+#else
+  uint32_t quirks = 0;
+#endif
+
+  int opt;
+  while ((opt = getopt(argc, argv, "Jin:c:f:s:k:q:m:l:o:h")) != -1) {
+    switch (opt) {
+      case 'J':
+        use_jit = 1;
+        break;
+      case 'i':
+        lockstep.skip_idle = 1;
+        break;
+      case 'n':
+        lockstep.interval = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        cycles = strtoull(optarg, NULL, 10);
+        break;
+      case 'f':
+        frequency = atoi(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'k':
+        keys = strtoul(optarg, NULL, 0);
+        break;
+      case 'q':
+        if (!chip8_parse_quirks(optarg, &quirks)) {
+          usage();
+          return -1;
+        }
+        break;
+      case 'm':
+        movie_name = optarg;
+        break;
+      case 'l':
+        state_name = optarg;
+        break;
+      case 'o':
+        lockstep.repro_name = optarg;
+        break;
+      default:
+        usage();
+        return -1;
+    }
+  }
+  const char *rom_name = optind < argc ? argv[optind] : NULL;
+  if ((!rom_name && !state_name) || (movie_name && !rom_name) ||
+      lockstep.interval == 0 || frequency <= 0) {
+    usage();
+    return -1;
+  }
+
+  MOVIE *movie = NULL;
+  if (movie_name && !(movie = movie_load(movie_name))) {
+    return -1;
+  }
+  if (use_jit && !(lockstep.jit = jit_init())) {
+    fprintf(stderr, "jit unavailable on this host\n");
+    movie_free(movie);
+    return -1;
+  }
+  if (movie) {
+    seed = movie->header.seed;
+    frequency = movie->header.frequency;
+    keys = 0;
+    quirks = movie->header.quirks;
+    cycles = cycles ? cycles : movie->header.cycles;
+  }
+  cycles = cycles ? cycles : 1000000;
+  lockstep.reference = chip8_init_quirks(quirks);
+  lockstep.candidate = chip8_init_quirks(quirks);
+  lockstep.start = malloc(sizeof(CHIP8_SNAPSHOT));
+  lockstep.probe = malloc(sizeof(CHIP8_SNAPSHOT));
+  int ret = -1;
+  if (lockstep.reference && lockstep.candidate && lockstep.start &&
+      lockstep.probe &&
+      prepare(&lockstep, rom_name, state_name, movie, seed, keys)) {
+    double start = headless_seconds();
+    int same = lockstep_run(&lockstep, movie, cycles, frequency);
+    double seconds = headless_seconds() - start;
+    if (same) {
+      printf("%llu instructions, %llu comparisons, cores match\n",
+             (unsigned long long)lockstep.cycle,
+             (unsigned long long)lockstep.compares);
+    }
+    fprintf(stderr, "%.3f s\n", seconds);
+    ret = same ? 0 : 1;
+  }
+  chip8_free(lockstep.reference);
+  chip8_free(lockstep.candidate);
+  free(lockstep.start);
+  free(lockstep.probe);
+  jit_free(lockstep.jit);
+  movie_free(movie);
+  return ret;
+}
@@ -0,0 +1,270 @@
+#include "movie.h"
+
+#include <limits.h>
+
+/**
+ * @brief FNV-1a hash of everything loaded above MEM_START, identifies the ROM
+ * a movie was recorded with
+ * @param  *chip8: instance right after loading the ROM
+ * @retval 64-bit hash
+ */
+uint64_t movie_rom_hash(CHIP8 *chip8) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (int i = MEM_START; i < MEM_SIZE; i++) {
+    hash ^= MEM_READ(chip8, i);
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief start recording a session
+ * @note seeds the instance, so call it after loading the ROM and before the
+ * first instruction
+ * @param  *chip8: instance to record
+ * @param  seed: PRNG seed for CXNN
+ * @param  frequency: emulated CPU frequency
+ * @param  hash_interval: frames between two framebuffer hashes
+ * @retval new movie, NULL when out of memory
+ */
+MOVIE *movie_new(CHIP8 *chip8, uint32_t seed, int frequency,
+                 uint32_t hash_interval) {
+  MOVIE *movie = calloc(1, sizeof(MOVIE));
+  if (!movie) {
+    return NULL;
+  }
+  movie->header.magic = MOVIE_MAGIC;
+  movie->header.version = MOVIE_VERSION;
+  movie->header.seed = seed;
+  movie->header.frequency = frequency;
+  movie->header.rom_hash = movie_rom_hash(chip8);
+  movie->header.quirks = chip8->image->quirks;
+  movie->header.hash_interval = hash_interval ? hash_interval : 1;
+  chip8_seed(chip8, seed);
+  return movie;
+}
+
+static int grow(void **array, uint32_t *capacity, uint32_t count,
+                size_t size) {
+  if (count < *capacity) {
+    return 1;
+  }
+  uint32_t new_capacity = *capacity ? *capacity * 2 : 256;
+  void *grown = realloc(*array, new_capacity * size);
+  if (!grown) {
+    return 0;
+  }
+  *array = grown;
+  *capacity = new_capacity;
+  return 1;
+}
+
+/**
+ * @brief record the key state, call before running each frame
+ * @param  *movie: movie being recorded
+ * @param  *chip8: recorded instance
+ * @retval None
+ */
+void movie_input(MOVIE *movie, CHIP8 *chip8) {
+  uint16_t keys = chip8_key_mask(chip8);
+  if (keys == movie->keys) {
+    return;
+  }
+  if (!grow((void **)&movie->events, &movie->event_capacity,
+            movie->header.event_count, sizeof(MOVIE_EVENT))) {
+    return;
+  }
+  MOVIE_EVENT *event = &movie->events[movie->header.event_count++];
+  event->cycle = movie->header.cycles;
+  event->keys = keys;
+  event->reserved = 0;
+  movie->keys = keys;
+}
+
+/**
+ * @brief close a frame, call after its timer tick
+ * @param  *movie: movie being recorded
+ * @param  *chip8: recorded instance
+ * @param  cycles: instructions run during the frame
+ * @retval None
+ */
+void movie_frame(MOVIE *movie, CHIP8 *chip8, uint32_t cycles) {
+  movie->header.cycles += cycles;
+  movie->header.frames++;
+  if (movie->header.frames % movie->header.hash_interval) {
+    return;
+  }
+  if (grow((void **)&movie->hashes, &movie->hash_capacity,
+           movie->header.hash_count, sizeof(uint64_t))) {
+    movie->hashes[movie->header.hash_count++] = headless_display_hash(chip8);
+  }
+}
+
+uint8_t movie_save(MOVIE *movie, const char *file_name) {
+  FILE *file = fopen(file_name, "wb");
+  if (!file) {
+    printf("open movie error\n");
+    return 0;
+  }
+  size_t events = movie->header.event_count;
+  size_t hashes = movie->header.hash_count;
+  uint8_t ok = fwrite(&movie->header, sizeof(MOVIE_HEADER), 1, file) == 1 &&
+               fwrite(movie->events, sizeof(MOVIE_EVENT), events, file) ==
+                   events &&
+               fwrite(movie->hashes, sizeof(uint64_t), hashes, file) == hashes;
+  fclose(file);
+  return ok;
+}
+
+/**
+ * Movies come from anywhere: replaying divides by hash_interval, runs
+ * frequency instructions a second and trusts the quirks and event order
+ */
+static uint8_t header_valid(const MOVIE_HEADER *header) {
+  return header->magic == MOVIE_MAGIC && header->version == MOVIE_VERSION &&
+         header->hash_interval && header->frequency &&
+         header->frequency <= INT_MAX && !(header->quirks & ~QUIRKS_ALL) &&
+         header->hash_count <= header->frames / header->hash_interval;
+}
+
+static uint8_t events_sorted(const MOVIE *movie) {
+  for (uint32_t i = 1; i < movie->header.event_count; i++) {
+    if (movie->events[i].cycle < movie->events[i - 1].cycle) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+MOVIE *movie_load(const char *file_name) {
+  FILE *file = fopen(file_name, "rb");
+  if (!file) {
+    printf("open movie error\n");
+    return NULL;
+  }
+  MOVIE *movie = calloc(1, sizeof(MOVIE));
+  if (!movie || fread(&movie->header, sizeof(MOVIE_HEADER), 1, file) != 1 ||
+      !header_valid(&movie->header)) {
+    printf("invalid movie\n");
+    fclose(file);
+    free(movie);
+    return NULL;
+  }
+  size_t events = movie->header.event_count;
+  size_t hashes = movie->header.hash_count;
+  movie->events = malloc(events * sizeof(MOVIE_EVENT) + 1);
+  movie->hashes = malloc(hashes * sizeof(uint64_t) + 1);
+  movie->event_capacity = events;
+  movie->hash_capacity = hashes;
+  if (!movie->events || !movie->hashes ||
+      fread(movie->events, sizeof(MOVIE_EVENT), events, file) != events ||
+      fread(movie->hashes, sizeof(uint64_t), hashes, file) != hashes) {
+    printf("truncated movie\n");
+    fclose(file);
+    movie_free(movie);
+    return NULL;
+  }
+  fclose(file);
+  if (!events_sorted(movie)) {
+    printf("invalid movie\n");
+    movie_free(movie);
+    return NULL;
+  }
+  return movie;
+}
+
+void movie_free(MOVIE *movie) {
+  if (!movie) {
+    return;
+  }
+  free(movie->events);
+  free(movie->hashes);
+  free(movie);
+}
+
+/**
+ * @brief replay a movie headless at full speed
+ * @note the instance must have the movie's ROM loaded, run with the movie's
+ * quirks and have nothing executed yet; it is seeded from the movie
+ * @param  *movie: recorded session
+ * @param  *chip8: instance to drive
+ * @param  hash_interval: print the framebuffer hash every that many frames, 0
+ * to print nothing
+ * @param  *out: output stream for the hashes
+ * @param  *capture: gets every frame, may be NULL
+ * @param  *stats: filled with the run statistics, may be NULL
+ * @retval number of recorded hashes the replay didn't reproduce
+ */
+uint32_t movie_replay(MOVIE *movie, CHIP8 *chip8, uint32_t hash_interval,
+                      FILE *out, CAPTURE *capture, HEADLESS_STATS *stats) {
+  MOVIE_HEADER *header = &movie->header;
+  chip8_seed(chip8, header->seed);
+  chip8_set_keys(chip8, 0);
+  uint32_t next_event = 0;
+  uint32_t next_hash = 0;
+  uint32_t mismatches = 0;
+  uint64_t cycle = 0;
+  uint8_t vip_clock = (chip8->image->quirks & QUIRK_VIP_CLOCK) != 0;
+  double start = headless_seconds();
+  for (uint64_t frame = 0; frame < header->frames; frame++) {
+    // frames of the VIP clock end where chip8_run_vip() says
+    uint64_t frame_end =
+        vip_clock ? UINT64_MAX
+                  : cycle + headless_frame_cycles(header->frequency, frame);
+    // split the frame at every key change that falls inside it
+    for (;;) {
+      while (next_event < header->event_count &&
+             movie->events[next_event].cycle <= cycle) {
+        chip8_set_keys(chip8, movie->events[next_event++].keys);
+      }
+      uint64_t until = frame_end;
+      if (next_event < header->event_count &&
+          movie->events[next_event].cycle < until) {
+        until = movie->events[next_event].cycle;
+      }
+      if (vip_clock) {
+        uint64_t left = until - cycle;
+        cycle += chip8_run_vip(chip8, left < UINT32_MAX ? left : UINT32_MAX);
+        if (chip8->vip_clock >= VIP_FRAME_CYCLES) {
+          break;
+        }
+        continue;
+      }
+      if (!chip8_skip_idle(chip8, until - cycle)) {
+        chip8_run(chip8, until - cycle);
+      }
+      cycle = until;
+      if (cycle == frame_end) {
+        break;
+      }
+    }
+    chip8_timer(chip8);
+    capture_frame(capture, chip8);
+
+    uint64_t frames = frame + 1;
+    uint64_t hash = 0;
+    if (frames % header->hash_interval == 0 ||
+        (hash_interval && frames % hash_interval == 0)) {
+      hash = headless_display_hash(chip8);
+    }
+    if (frames % header->hash_interval == 0 && next_hash < header->hash_count &&
+        movie->hashes[next_hash++] != hash) {
+      if (!mismatches && out) {
+        fprintf(out, "frame %llu: hash mismatch\n", (unsigned long long)frames);
+      }
+      mismatches++;
+    }
+    if (hash_interval && frames % hash_interval == 0 && out) {
+      fprintf(out, "frame %llu hash %016llx\n", (unsigned long long)frames,
+              (unsigned long long)hash);
+    }
+  }
+  double seconds = headless_seconds() - start;
+  if (stats) {
+    stats->cycles = cycle;
+    stats->frames = header->frames;
+    stats->seconds = seconds;
+    stats->ips = seconds > 0 ? cycle / seconds : 0;
+  }
+  return mismatches;
+}
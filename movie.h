@@ -0,0 +1,63 @@
+#ifndef __MOVIE_H__
+#define __MOVIE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+#include "headless.h"
+
+#define MOVIE_MAGIC 0x564D3843  // "C8MV"
+#define MOVIE_VERSION 1
+// frames between two recorded framebuffer hashes
+#define MOVIE_HASH_INTERVAL 60
+
+// the key mask becomes `keys` once `cycle` instructions have run
+typedef struct movie_event {
+  uint64_t cycle;
+  uint32_t keys;
+  uint32_t reserved;
+} MOVIE_EVENT;
+
+typedef struct movie_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t seed;  // chip8_seed() value, drives CXNN
+  uint32_t frequency;
+  uint64_t rom_hash;
+  uint64_t frames;  // length of the session
+  uint64_t cycles;
+  uint32_t event_count;
+  uint32_t hash_interval;
+  uint32_t hash_count;
+  uint32_t quirks;  // QUIRK_* flags, 0 in movies older than quirk profiles
+} MOVIE_HEADER;
+
+typedef struct movie {
+  MOVIE_HEADER header;
+  MOVIE_EVENT *events;
+  uint64_t *hashes;  // framebuffer hash after every hash_interval frames
+  uint32_t event_capacity;
+  uint32_t hash_capacity;
+  uint16_t keys;  // last recorded key mask
+} MOVIE;
+
+uint64_t movie_rom_hash(CHIP8 *chip8);
+
+MOVIE *movie_new(CHIP8 *chip8, uint32_t seed, int frequency,
+                 uint32_t hash_interval);
+
+void movie_input(MOVIE *movie, CHIP8 *chip8);
+
+void movie_frame(MOVIE *movie, CHIP8 *chip8, uint32_t cycles);
+
+uint8_t movie_save(MOVIE *movie, const char *file_name);
+
+MOVIE *movie_load(const char *file_name);
+
+void movie_free(MOVIE *movie);
+
+uint32_t movie_replay(MOVIE *movie, CHIP8 *chip8, uint32_t hash_interval,
+                      FILE *out, CAPTURE *capture, HEADLESS_STATS *stats);
+
+#endif  //__MOVIE_H__
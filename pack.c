@@ -0,0 +1,404 @@
+#include "pack.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// largest image chip8_image_new() and chip8_image_map() accept
+#define PACK_ROM_MAX (MEM_SIZE - MEM_START - 1)
+
+/**
+ * @brief FNV-1a hash of a ROM image, the key packs are indexed and
+ * deduplicated by
+ * @param  *data: ROM image
+ * @param  size: image size in bytes
+ * @retval 64-bit hash
+ */
+uint64_t pack_hash(const uint8_t *data, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+// every table and ROM image of the pack lies inside the mapping
+static uint8_t pack_valid(PACK *pack) {
+  const PACK_HEADER *header = pack->header;
+  if (pack->size < sizeof(PACK_HEADER) || header->magic != PACK_MAGIC ||
+      header->version != PACK_VERSION || header->size != pack->size) {
+    return 0;
+  }
+  uint64_t count = header->entry_count;
+  if (sizeof(PACK_HEADER) + count * (sizeof(PACK_ENTRY) + sizeof(uint32_t)) >
+      pack->size) {
+    return 0;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    const PACK_ENTRY *entry = &pack->entries[i];
+    if (entry->size > PACK_ROM_MAX ||
+        (uint64_t)entry->offset + entry->size > pack->size ||
+        entry->name >= pack->size ||
+        !memchr(pack->base + entry->name, 0, pack->size - entry->name) ||
+        pack->by_name[i] >= count) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief map a pack file
+ * @param  *file_name: file written by pack_write
+ * @retval opened pack, NULL when missing or malformed
+ */
+PACK *pack_open(const char *file_name) {
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    printf("open pack error\n");
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < (off_t)sizeof(PACK_HEADER)) {
+    printf("invalid pack\n");
+    close(fd);
+    return NULL;
+  }
+  const uint8_t *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  PACK *pack = malloc(sizeof(PACK));
+  if (!pack) {
+    munmap((void *)base, st.st_size);
+    return NULL;
+  }
+  pack->base = base;
+  pack->size = st.st_size;
+  pack->header = (const PACK_HEADER *)base;
+  pack->entries = (const PACK_ENTRY *)(base + sizeof(PACK_HEADER));
+  pack->by_name =
+      (const uint32_t *)(pack->entries + pack->header->entry_count);
+  if (!pack_valid(pack)) {
+    printf("invalid pack\n");
+    pack_close(pack);
+    return NULL;
+  }
+  return pack;
+}
+
+void pack_close(PACK *pack) {
+  if (!pack) {
+    return;
+  }
+  munmap((void *)pack->base, pack->size);
+  free(pack);
+}
+
+/**
+ * First entry with the given content hash, NULL if there is none
+ */
+const PACK_ENTRY *pack_find_hash(PACK *pack, uint64_t hash) {
+  uint32_t low = 0;
+  uint32_t high = pack->header->entry_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (pack->entries[mid].hash < hash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low < pack->header->entry_count && pack->entries[low].hash == hash) {
+    return &pack->entries[low];
+  }
+  return NULL;
+}
+
+/**
+ * Entry with the given name, NULL if there is none
+ */
+const PACK_ENTRY *pack_find_name(PACK *pack, const char *name) {
+  uint32_t low = 0;
+  uint32_t high = pack->header->entry_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    const PACK_ENTRY *entry = &pack->entries[pack->by_name[mid]];
+    int cmp = strcmp(pack_name(pack, entry), name);
+    if (cmp == 0) {
+      return entry;
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NULL;
+}
+
+const char *pack_name(PACK *pack, const PACK_ENTRY *entry) {
+  return (const char *)pack->base + entry->name;
+}
+
+const uint8_t *pack_data(PACK *pack, const PACK_ENTRY *entry) {
+  return pack->base + entry->offset;
+}
+
+/**
+ * @brief memory image of a ROM with its quirks, read straight from the
+ * mapping: only a last partial page of the ROM is copied
+ * @note the pack must stay open while the image is used
+ * @retval the image, NULL when the ROM doesn't fit or out of memory
+ */
+CHIP8_IMAGE *pack_image(PACK *pack, const PACK_ENTRY *entry) {
+  return chip8_image_map(pack_data(pack, entry), entry->size, entry->quirks);
+}
+
+typedef struct pack_item {
+  char *name;
+  uint64_t hash;
+  uint32_t blob;
+  uint32_t quirks;
+  uint16_t frequency;
+} PACK_ITEM;
+
+typedef struct pack_blob {
+  uint64_t hash;
+  uint8_t *data;
+  uint32_t size;
+  uint32_t offset;
+} PACK_BLOB;
+
+struct pack_builder {
+  PACK_ITEM *items;
+  uint32_t item_count;
+  uint32_t item_capacity;
+  PACK_BLOB *blobs;
+  uint32_t blob_count;
+  uint32_t blob_capacity;
+  // open addressing table of blob index + 1 by hash, a power of two in size
+  uint32_t *slots;
+  uint32_t slot_count;
+};
+
+PACK_BUILDER *pack_builder_new() { return calloc(1, sizeof(PACK_BUILDER)); }
+
+static int grow(void **array, uint32_t *capacity, uint32_t count,
+                size_t size) {
+  if (count < *capacity) {
+    return 1;
+  }
+  uint32_t new_capacity = *capacity ? *capacity * 2 : 256;
+  void *grown = realloc(*array, new_capacity * size);
+  if (!grown) {
+    return 0;
+  }
+  *array = grown;
+  *capacity = new_capacity;
+  return 1;
+}
+
+static uint32_t *find_slot(PACK_BUILDER *builder, uint64_t hash,
+                           const uint8_t *data, size_t size) {
+  uint32_t mask = builder->slot_count - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t *slot = &builder->slots[i];
+    if (!*slot) {
+      return slot;
+    }
+    PACK_BLOB *blob = &builder->blobs[*slot - 1];
+    if (blob->hash == hash && blob->size == size &&
+        memcmp(blob->data, data, size) == 0) {
+      return slot;
+    }
+  }
+}
+
+// keep the table at most half full
+static int grow_slots(PACK_BUILDER *builder) {
+  if (builder->blob_count * 2 < builder->slot_count) {
+    return 1;
+  }
+  uint32_t slot_count = builder->slot_count ? builder->slot_count * 2 : 1024;
+  uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+  if (!slots) {
+    return 0;
+  }
+  free(builder->slots);
+  builder->slots = slots;
+  builder->slot_count = slot_count;
+  for (uint32_t i = 0; i < builder->blob_count; i++) {
+    PACK_BLOB *blob = &builder->blobs[i];
+    *find_slot(builder, blob->hash, blob->data, blob->size) = i + 1;
+  }
+  return 1;
+}
+
+/**
+ * @brief add a ROM to a pack being built, identical images are stored once
+ * @param  *builder: pack being built
+ * @param  *name: name to look the ROM up by, unique within the pack
+ * @param  *data: ROM image, copied
+ * @param  size: image size in bytes
+ * @param  frequency: preferred CPU frequency, 0 for the default
+ * @param  quirks: quirk flags the ROM expects
+ * @retval 1 on success
+ */
+uint8_t pack_add(PACK_BUILDER *builder, const char *name, const uint8_t *data,
+                 size_t size, uint16_t frequency, uint32_t quirks) {
+  if (size > PACK_ROM_MAX) {
+    printf("memory overflow");
+    return 0;
+  }
+  if (!grow_slots(builder) ||
+      !grow((void **)&builder->items, &builder->item_capacity,
+            builder->item_count, sizeof(PACK_ITEM))) {
+    return 0;
+  }
+  uint64_t hash = pack_hash(data, size);
+  uint32_t *slot = find_slot(builder, hash, data, size);
+  if (!*slot) {
+    if (!grow((void **)&builder->blobs, &builder->blob_capacity,
+              builder->blob_count, sizeof(PACK_BLOB))) {
+      return 0;
+    }
+    PACK_BLOB *blob = &builder->blobs[builder->blob_count];
+    blob->hash = hash;
+    blob->size = size;
+    blob->data = malloc(size + 1);
+    if (!blob->data) {
+      return 0;
+    }
+    memcpy(blob->data, data, size);
+    *slot = ++builder->blob_count;
+  }
+  PACK_ITEM *item = &builder->items[builder->item_count];
+  item->name = strdup(name);
+  if (!item->name) {
+    return 0;
+  }
+  item->hash = hash;
+  item->blob = *slot - 1;
+  item->frequency = frequency;
+  item->quirks = quirks;
+  builder->item_count++;
+  return 1;
+}
+
+static int compare_items(const void *a, const void *b) {
+  const PACK_ITEM *x = a;
+  const PACK_ITEM *y = b;
+  if (x->hash != y->hash) {
+    return x->hash < y->hash ? -1 : 1;
+  }
+  return strcmp(x->name, y->name);
+}
+
+typedef struct pack_sort_name {
+  const char *name;
+  uint32_t index;
+} PACK_SORT_NAME;
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(((const PACK_SORT_NAME *)a)->name, ((const PACK_SORT_NAME *)b)->name);
+}
+
+/**
+ * @brief write every added ROM to a pack file
+ * @param  *builder: pack being built
+ * @param  *file_name: output file
+ * @retval 1 on success, 0 on I/O errors, duplicate names or a pack over 4 GB
+ */
+uint8_t pack_write(PACK_BUILDER *builder, const char *file_name) {
+  uint32_t count = builder->item_count;
+  qsort(builder->items, count, sizeof(PACK_ITEM), compare_items);
+  PACK_SORT_NAME *names = malloc((count + 1) * sizeof(PACK_SORT_NAME));
+  if (!names) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    names[i].name = builder->items[i].name;
+    names[i].index = i;
+  }
+  qsort(names, count, sizeof(PACK_SORT_NAME), compare_names);
+  for (uint32_t i = 1; i < count; i++) {
+    if (strcmp(names[i - 1].name, names[i].name) == 0) {
+      printf("duplicate rom name: %s\n", names[i].name);
+      free(names);
+      return 0;
+    }
+  }
+
+  // lay the file out: tables, names, then images
+  uint64_t offset = sizeof(PACK_HEADER) +
+                    (uint64_t)count * (sizeof(PACK_ENTRY) + sizeof(uint32_t));
+  uint64_t names_offset = offset;
+  for (uint32_t i = 0; i < count; i++) {
+    offset += strlen(builder->items[i].name) + 1;
+  }
+  for (uint32_t i = 0; i < builder->blob_count; i++) {
+    builder->blobs[i].offset = offset;
+    offset += builder->blobs[i].size;
+  }
+  if (offset > UINT32_MAX) {
+    printf("pack too large\n");
+    free(names);
+    return 0;
+  }
+
+  FILE *file = fopen(file_name, "wb");
+  if (!file) {
+    printf("open pack error\n");
+    free(names);
+    return 0;
+  }
+  PACK_HEADER header = {PACK_MAGIC, PACK_VERSION, count, 0, offset};
+  uint8_t ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  uint64_t name = names_offset;
+  for (uint32_t i = 0; i < count && ok; i++) {
+    PACK_ITEM *item = &builder->items[i];
+    PACK_BLOB *blob = &builder->blobs[item->blob];
+    PACK_ENTRY entry = {0};
+    entry.hash = item->hash;
+    entry.offset = blob->offset;
+    entry.size = blob->size;
+    entry.name = name;
+    entry.quirks = item->quirks;
+    entry.frequency = item->frequency;
+    name += strlen(item->name) + 1;
+    ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+  }
+  for (uint32_t i = 0; i < count && ok; i++) {
+    ok = fwrite(&names[i].index, sizeof(uint32_t), 1, file) == 1;
+  }
+  for (uint32_t i = 0; i < count && ok; i++) {
+    const char *item_name = builder->items[i].name;
+    ok = fwrite(item_name, strlen(item_name) + 1, 1, file) == 1;
+  }
+  for (uint32_t i = 0; i < builder->blob_count && ok; i++) {
+    PACK_BLOB *blob = &builder->blobs[i];
+    ok = fwrite(blob->data, 1, blob->size, file) == blob->size;
+  }
+  ok = fclose(file) == 0 && ok;
+  free(names);
+  return ok;
+}
+
+void pack_builder_free(PACK_BUILDER *builder) {
+  if (!builder) {
+    return;
+  }
+  for (uint32_t i = 0; i < builder->item_count; i++) {
+    free(builder->items[i].name);
+  }
+  for (uint32_t i = 0; i < builder->blob_count; i++) {
+    free(builder->blobs[i].data);
+  }
+  free(builder->items);
+  free(builder->blobs);
+  free(builder->slots);
+  free(builder);
+}
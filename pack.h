@@ -0,0 +1,75 @@
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define PACK_MAGIC 0x4B503843  // "C8PK"
+#define PACK_VERSION 1
+
+/**
+ * A ROM pack is one file holding many ROMs, opened with a single mmap:
+ *
+ *   PACK_HEADER
+ *   PACK_ENTRY[entry_count]   sorted by content hash, then name
+ *   uint32_t[entry_count]     entry indices sorted by name
+ *   names                     NUL-terminated
+ *   ROM images                stored once per distinct content
+ *
+ * Offsets are from the start of the file.
+ */
+typedef struct pack_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t reserved;
+  uint64_t size;  // file size
+} PACK_HEADER;
+
+typedef struct pack_entry {
+  uint64_t hash;       // pack_hash() of the ROM image
+  uint32_t offset;     // ROM image
+  uint32_t size;       // ROM image size in bytes
+  uint32_t name;       // NUL-terminated name
+  uint32_t quirks;     // QUIRK_* flags the ROM expects
+  uint16_t frequency;  // preferred CPU frequency, 0 for the default
+  uint16_t reserved[3];
+} PACK_ENTRY;
+
+typedef struct pack {
+  const uint8_t *base;
+  size_t size;
+  const PACK_HEADER *header;
+  const PACK_ENTRY *entries;
+  const uint32_t *by_name;
+} PACK;
+
+uint64_t pack_hash(const uint8_t *data, size_t size);
+
+PACK *pack_open(const char *file_name);
+
+void pack_close(PACK *pack);
+
+const PACK_ENTRY *pack_find_hash(PACK *pack, uint64_t hash);
+
+const PACK_ENTRY *pack_find_name(PACK *pack, const char *name);
+
+const char *pack_name(PACK *pack, const PACK_ENTRY *entry);
+
+const uint8_t *pack_data(PACK *pack, const PACK_ENTRY *entry);
+
+CHIP8_IMAGE *pack_image(PACK *pack, const PACK_ENTRY *entry);
+
+typedef struct pack_builder PACK_BUILDER;
+
+PACK_BUILDER *pack_builder_new();
+
+uint8_t pack_add(PACK_BUILDER *builder, const char *name, const uint8_t *data,
+                 size_t size, uint16_t frequency, uint32_t quirks);
+
+uint8_t pack_write(PACK_BUILDER *builder, const char *file_name);
+
+void pack_builder_free(PACK_BUILDER *builder);
+
+#endif  //__PACK_H__
@@ -0,0 +1,136 @@
+/**
+ * Build and inspect ROM packs.
+ *
+ * ROMs come from the command line, all with the -f/-q metadata, and from a
+ * list file with one `path<TAB>frequency<TAB>quirks` line per ROM. Quirks are
+ * a profile name or QUIRK_* flags, see chip8_parse_quirks(). Each ROM is
+ * named after its file name without the directory.
+ */
+#include <unistd.h>
+
+#include "pack.h"
+
+static const char *base_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static int add_file(PACK_BUILDER *builder, const char *path,
+                    uint16_t frequency, uint32_t quirks) {
+  uint8_t data[MEM_SIZE];
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "open rom error: %s\n", path);
+    return 0;
+  }
+  size_t size = fread(data, 1, sizeof(data), file);
+  fclose(file);
+  if (!pack_add(builder, base_name(path), data, size, frequency, quirks)) {
+    fprintf(stderr, "can't add rom: %s\n", path);
+    return 0;
+  }
+  return 1;
+}
+
+static int add_list(PACK_BUILDER *builder, const char *list_name) {
+  FILE *list = fopen(list_name, "r");
+  if (!list) {
+    fprintf(stderr, "open list error: %s\n", list_name);
+    return 0;
+  }
+  char line[4096];
+  int ok = 1;
+  while (ok && fgets(line, sizeof(line), list)) {
+    line[strcspn(line, "\r\n")] = 0;
+    if (!line[0] || line[0] == '#') {
+      continue;
+    }
+    char *fields = strchr(line, '\t');
+    unsigned long frequency = 0;
+    uint32_t quirks = 0;
+    if (fields) {
+      *fields++ = 0;
+      char *end;
+      frequency = strtoul(fields, &end, 0);
+      if (*end == '\t' && !chip8_parse_quirks(end + 1, &quirks)) {
+        fprintf(stderr, "unknown quirks: %s\n", end + 1);
+        ok = 0;
+        break;
+      }
+    }
+    ok = add_file(builder, line, frequency, quirks);
+  }
+  fclose(list);
+  return ok;
+}
+
+static int list_pack(const char *file_name) {
+  PACK *pack = pack_open(file_name);
+  if (!pack) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < pack->header->entry_count; i++) {
+    const PACK_ENTRY *entry = &pack->entries[pack->by_name[i]];
+    printf("%016llx %5u %4u 0x%08x %s\n", (unsigned long long)entry->hash,
+           entry->size, entry->frequency, entry->quirks,
+           pack_name(pack, entry));
+  }
+  pack_close(pack);
+  return 0;
+}
+
+static void usage() {
+  printf(
+      "usage: ./chip8-pack [-f frequency] [-q quirks] [-i list] -o <pack> "
+      "[rom]...\n");
+  printf("       ./chip8-pack -l <pack>\n");
+}
+
+int main(int argc, char *const argv[]) {
+  uint16_t frequency = 0;
+  uint32_t quirks = 0;
+  const char *list = NULL;
+  const char *output = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:q:i:o:l:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        frequency = atoi(optarg);
+        break;
+      case 'q':
+        if (!chip8_parse_quirks(optarg, &quirks)) {
+          usage();
+          return -1;
+        }
+        break;
+      case 'i':
+        list = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'l':
+        return list_pack(optarg);
+      default:
+        usage();
+        return -1;
+    }
+  }
+  if (!output || (optind >= argc && !list)) {
+    usage();
+    return -1;
+  }
+
+  PACK_BUILDER *builder = pack_builder_new();
+  int ok = builder != NULL;
+  if (ok && list) {
+    ok = add_list(builder, list);
+  }
+  for (int i = optind; ok && i < argc; i++) {
+    ok = add_file(builder, argv[i], frequency, quirks);
+  }
+  ok = ok && pack_write(builder, output);
+  pack_builder_free(builder);
+  return ok ? 0 : -1;
+}
@@ -1,8 +1,21 @@
 #include "port.h"
 
+#include "audio.h"
+
+// samples the audio device asks for per callback, about 5 ms
+#define AUDIO_DEVICE_SAMPLES 256
+
 static SDL_Window *window;
 static SDL_Renderer *renderer;
 static SDL_Texture *texture;
+static SDL_AudioDeviceID audio_device;
+// event type announcing a finished frame
+static Uint32 frame_event;
+static AUDIO_RING audio_ring;
+static AUDIO_VOICE audio_voice;
+// samples kept queued: a frame plus one device buffer, a frame can hold one
+// callback more than the average
+static uint32_t audio_queue_target;
 
 /**
  * @brief init SDL2 windows
@@ -15,6 +28,7 @@ static SDL_Texture *texture;
  */
 uint8_t init_display(const char *title, int scale, int width, int height) {
   SDL_Init(SDL_INIT_VIDEO);
+  frame_event = SDL_RegisterEvents(1);
   window =
       SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                        width * scale, height * scale, SDL_WINDOW_SHOWN);
@@ -54,52 +68,179 @@ void close_display() {
  */
 void handle_display(void *display, int pitch) {
   SDL_UpdateTexture(texture, NULL, display, pitch);
+  present_display();
+}
+
+/**
+ * @brief upload some rows of the texture without presenting
+ * @note
+ * @param  *pixels: first row to upload
+ * @param  pitch: the number of bytes in a row of pixel data
+ * @param  y: index of the first row in the texture
+ * @param  rows: number of rows
+ * @retval None
+ */
+void update_display(const void *pixels, int pitch, int y, int rows) {
+  SDL_Rect rect = {0, y, pitch / 4, rows};
+  SDL_UpdateTexture(texture, &rect, pixels, pitch);
+}
+
+/**
+ * @brief show the current texture
+ * @note
+ * @retval None
+ */
+void present_display() {
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
   SDL_RenderPresent(renderer);
 }
 
+static void handle_event(SDL_Event *e, uint8_t *keys,
+                         enum sys_state *state) {
+  if (e->type == SDL_QUIT) {
+    *state = SYS_QUIT;
+  }
+  if (e->type == SDL_KEYDOWN) {
+    switch (e->key.keysym.sym) {
+      case SDLK_ESCAPE:
+        *state = SYS_QUIT;
+        break;
+      case SDLK_SPACE:
+        if (*state == SYS_PAUSE) {
+          *state = SYS_RUNNING;
+        } else {
+          *state = SYS_PAUSE;
+        }
+        break;
+      default:
+        for (int i = 0; i < KEY_SIZE; i++) {
+          if (KEY_MAP[i] == e->key.keysym.sym) {
+            // printf("key press: %c\n", KEY_MAP[i]);
+            keys[i] = 1;
+          }
+        }
+        break;
+    }
+  } else if (e->type == SDL_KEYUP) {
+    for (int i = 0; i < KEY_SIZE; i++) {
+      if (KEY_MAP[i] == e->key.keysym.sym) {
+        keys[i] = 0;
+      }
+    }
+  }
+}
+
 /**
  * @brief handle modern computer keyboard
  * @note
  * @param  *keys: key array
- * @retval 1 for continue, 0 for quit
+ * @param  *state: set to quit or toggled between pause and running
+ * @retval None
  */
-void handle_keypad(uint8_t *keys, CHIP8 *chip8) {
+void handle_keypad(uint8_t *keys, enum sys_state *state) {
   SDL_Event e;
   while (SDL_PollEvent(&e)) {
-    if (e.type == SDL_QUIT) {
-      chip8->state = SYS_QUIT;
-    }
-    if (e.type == SDL_KEYDOWN) {
-      switch (e.key.keysym.sym) {
-        case SDLK_ESCAPE:
-          chip8->state = SYS_QUIT;
-          break;
-        case SDLK_SPACE:
-          if (chip8->state == SYS_PAUSE) {
-            chip8->state = SYS_RUNNING;
-          } else {
-            chip8->state = SYS_PAUSE;
-          }
-          break;
-        default:
-          for (int i = 0; i < KEY_SIZE; i++) {
-            if (KEY_MAP[i] == e.key.keysym.sym) {
-              // printf("key press: %c\n", KEY_MAP[i]);
-              keys[i] = 1;
-            }
-          }
-          break;
-      }
-    } else if (e.type == SDL_KEYUP) {
-      for (int i = 0; i < KEY_SIZE; i++) {
-        if (KEY_MAP[i] == e.key.keysym.sym) {
-          keys[i] = 0;
-        }
-      }
-    }
+    handle_event(&e, keys, state);
   }
 }
 
-void handle_sound() {}
\ No newline at end of file
+/**
+ * @brief like handle_keypad, but sleep until at least one event arrives,
+ * notify_frame() counts as one
+ * @note
+ * @param  *keys: key array
+ * @param  *state: set to quit or toggled between pause and running
+ * @retval None
+ */
+void wait_keypad(uint8_t *keys, enum sys_state *state) {
+  SDL_Event e;
+  if (SDL_WaitEvent(&e)) {
+    handle_event(&e, keys, state);
+  }
+  handle_keypad(keys, state);
+}
+
+/**
+ * @brief wake a thread sleeping in wait_keypad, safe from any thread
+ * @note
+ * @retval None
+ */
+void notify_frame() {
+  SDL_Event e = {0};
+  e.type = frame_event;
+  SDL_PushEvent(&e);
+}
+
+/**
+ * Audio callback, runs on SDL's audio thread and only ever takes samples out
+ * of the ring; whatever the ring can't supply is silence.
+ */
+static void audio_callback(void *userdata, Uint8 *stream, int len) {
+  int16_t *samples = (int16_t *)stream;
+  uint32_t n = len / sizeof(int16_t);
+  uint32_t got = audio_ring_pop(&audio_ring, samples, n);
+  memset(samples + got, 0, (n - got) * sizeof(int16_t));
+}
+
+/**
+ * @brief open the audio device, the emulator stays silent when it fails
+ * @note
+ * @retval 1 for success, 0 for no audio
+ */
+uint8_t init_sound() {
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    return 0;
+  }
+  SDL_AudioSpec want = {0};
+  want.freq = AUDIO_RATE;
+  want.format = AUDIO_S16SYS;
+  want.channels = 1;
+  want.samples = AUDIO_DEVICE_SAMPLES;
+  want.callback = audio_callback;
+  SDL_AudioSpec obtained;
+  audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &obtained, 0);
+  if (!audio_device) {
+    return 0;
+  }
+  audio_queue_target = AUDIO_FRAME_SAMPLES + obtained.samples;
+  if (audio_queue_target > AUDIO_RING_SIZE) {
+    audio_queue_target = AUDIO_RING_SIZE;
+  }
+  SDL_PauseAudioDevice(audio_device, 0);
+  return 1;
+}
+
+/**
+ * @brief close the audio device
+ * @note
+ * @retval None
+ */
+void close_sound() {
+  if (audio_device) {
+    SDL_CloseAudioDevice(audio_device);
+    audio_device = 0;
+  }
+}
+
+/**
+ * @brief queue the sound of one frame while the sound timer runs
+ * @note never blocks: the ring is topped up to one frame plus one device
+ * buffer of samples, so the sound lags the emulation by at most that, about
+ * 22 ms with a 256 sample buffer
+ * @param  *chip8: machine whose audio pattern is played
+ * @retval None
+ */
+void handle_sound(CHIP8 *chip8) {
+  if (!audio_device) {
+    return;
+  }
+  uint32_t queued = audio_ring_count(&audio_ring);
+  if (queued >= audio_queue_target) {
+    return;
+  }
+  int16_t samples[AUDIO_RING_SIZE];
+  uint32_t n = audio_queue_target - queued;
+  audio_render(&audio_voice, chip8, samples, n);
+  audio_ring_push(&audio_ring, samples, n);
+}
\ No newline at end of file
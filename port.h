@@ -41,8 +41,20 @@ void close_display();
 
 void handle_display(void *display, int pitch);
 
-void handle_keypad(uint8_t *keys, CHIP8 *chip8);
+void update_display(const void *pixels, int pitch, int y, int rows);
 
-void handle_sound();
+void present_display();
+
+void handle_keypad(uint8_t *keys, enum sys_state *state);
+
+void wait_keypad(uint8_t *keys, enum sys_state *state);
+
+void notify_frame();
+
+uint8_t init_sound();
+
+void close_sound();
+
+void handle_sound(CHIP8 *chip8);
 
 #endif  //__PORT_H__
\ No newline at end of file
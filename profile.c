@@ -0,0 +1,215 @@
+#include "profile.h"
+
+#ifdef CHIP8_PROFILE
+
+#include <signal.h>
+
+#define PROFILE_TOP 32
+// bytes per cell of the memory heat maps
+#define HEAT_CELL 16
+#define HEAT_COLUMNS 16
+
+PROFILE *chip8_profile;
+
+// set by SIGUSR1, the report is written by the next profiled instruction or
+// timer tick. Several threads may see it, only the one clearing it writes.
+static atomic_int report_requested;
+
+// add to a counter shared by the threads, relaxed: counters order nothing
+// else, every one only has to reach its own total
+#define COUNT(counter, n) \
+  atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+
+static void write_report() {
+  FILE *out = fopen(chip8_profile->file_name, "w");
+  if (!out) {
+    fprintf(stderr, "open profile report error\n");
+    return;
+  }
+  profile_report(chip8_profile, out);
+  fclose(out);
+}
+
+static void on_signal(int sig) { atomic_store(&report_requested, 1); }
+
+/**
+ * Write the report if SIGUSR1 asked for one
+ */
+static void check_report() {
+  if (atomic_load_explicit(&report_requested, memory_order_relaxed) &&
+      atomic_exchange(&report_requested, 0)) {
+    write_report();
+  }
+}
+
+/**
+ * @brief turn profiling on when CHIP8_PROFILE_REPORT names a report file
+ * @note call once at startup, before anything runs
+ * @retval None
+ */
+void profile_init() {
+  const char *file_name = getenv("CHIP8_PROFILE_REPORT");
+  if (!file_name || chip8_profile) {
+    return;
+  }
+  PROFILE *profile = calloc(1, sizeof(PROFILE));
+  if (!profile) {
+    return;
+  }
+  profile->file_name = file_name;
+  chip8_profile = profile;
+  signal(SIGUSR1, on_signal);
+  atexit(write_report);
+}
+
+void profile_exec(CHIP8 *chip8, uint16_t pc, const CHIP8_INST *inst) {
+  COUNT(chip8_profile->instructions, 1);
+  COUNT(chip8_profile->opcodes[inst->opcode], 1);
+  COUNT(chip8_profile->pc[pc], 1);
+  atomic_store_explicit(&chip8_profile->last_opcode[pc], inst->opcode,
+                        memory_order_relaxed);
+  check_report();
+}
+
+void profile_mem(PROFILE_COUNTER *heat, uint16_t addr, uint16_t len) {
+  for (uint16_t i = 0; i < len; i++) {
+    COUNT(heat[(addr + i) & (MEM_SIZE - 1)], 1);
+  }
+}
+
+/**
+ * Timer tick: instances waiting for a key or idle skip whole frames without
+ * running an instruction, the report must not wait for the next one
+ */
+void profile_frame() { check_report(); }
+
+static double percent(uint64_t count, uint64_t total) {
+  return total ? 100.0 * count / total : 0;
+}
+
+/**
+ * Indices of the PROFILE_TOP largest nonzero counters, largest first
+ */
+static int top_counters(const PROFILE_COUNTER *counts, int size, int *top) {
+  int found = 0;
+  for (int i = 0; i < size; i++) {
+    if (!counts[i]) {
+      continue;
+    }
+    int j = found < PROFILE_TOP ? found++ : PROFILE_TOP;
+    while (j > 0 && counts[top[j - 1]] < counts[i]) {
+      if (j < PROFILE_TOP) {
+        top[j] = top[j - 1];
+      }
+      j--;
+    }
+    if (j < PROFILE_TOP) {
+      top[j] = i;
+    }
+  }
+  return found;
+}
+
+/**
+ * One character per HEAT_CELL bytes, darker is hotter on a log scale
+ */
+static void heat_map(const PROFILE_COUNTER *heat, const char *title,
+                     FILE *out) {
+  static const char SCALE[] = " .:-=+*#%@";
+  uint64_t cells[MEM_SIZE / HEAT_CELL] = {0};
+  uint64_t max = 0;
+  for (int i = 0; i < MEM_SIZE; i++) {
+    cells[i / HEAT_CELL] += heat[i];
+  }
+  for (int i = 0; i < MEM_SIZE / HEAT_CELL; i++) {
+    max = cells[i] > max ? cells[i] : max;
+  }
+  int max_bits = 64 - __builtin_clzll(max | 1);
+  fprintf(out, "\n%s, %d bytes per cell\n", title, HEAT_CELL);
+  for (int row = 0; row < MEM_SIZE / HEAT_CELL / HEAT_COLUMNS; row++) {
+    fprintf(out, "%03X |", row * HEAT_CELL * HEAT_COLUMNS);
+    for (int col = 0; col < HEAT_COLUMNS; col++) {
+      uint64_t cell = cells[row * HEAT_COLUMNS + col];
+      int level = 0;
+      if (cell) {
+        int bits = 64 - __builtin_clzll(cell);
+        level = 1 + (bits * (int)(sizeof(SCALE) - 3)) / max_bits;
+      }
+      fputc(SCALE[level], out);
+    }
+    fprintf(out, "|\n");
+  }
+}
+
+static void top_addresses(const PROFILE_COUNTER *heat, const char *title,
+                          FILE *out) {
+  int top[PROFILE_TOP];
+  int found = top_counters(heat, MEM_SIZE, top);
+  fprintf(out, "\n%s\n", title);
+  for (int i = 0; i < found && i < PROFILE_TOP; i++) {
+    fprintf(out, "  %03X %12llu\n", top[i], (unsigned long long)heat[top[i]]);
+  }
+}
+
+/**
+ * @brief write a text report: executions per handler, hottest instructions
+ * and memory heat maps
+ * @param  *profile: collected counters
+ * @param  *out: output stream
+ * @retval None
+ */
+void profile_report(PROFILE *profile, FILE *out) {
+  uint64_t total = profile->instructions;
+  fprintf(out, "instructions %llu\n", (unsigned long long)total);
+
+  // fold the per-opcode counters into their handlers
+  size_t count = chip8_handler_count;
+  PROFILE_COUNTER handlers[count + 1];
+  for (size_t i = 0; i <= count; i++) {
+    atomic_init(&handlers[i], 0);
+  }
+  for (int opcode = 0; opcode < 0x10000; opcode++) {
+    if (!profile->opcodes[opcode]) {
+      continue;
+    }
+    // quirk variants count as the instruction they vary
+    CHIP8_INST inst;
+    chip8_decode(opcode, 0, &inst);
+    size_t i = 0;
+    while (i < count && chip8_handlers[i].func != inst.func) {
+      i++;
+    }
+    // unknown encodings share the last slot
+    handlers[i] += profile->opcodes[opcode];
+  }
+  int order[count + 1];
+  int found = top_counters(handlers, count + 1, order);
+  fprintf(out, "\nhandlers\n");
+  for (int i = 0; i < found && i < PROFILE_TOP; i++) {
+    uint64_t executed = handlers[order[i]];
+    fprintf(out, "  %-4s %12llu %6.2f%%\n",
+            order[i] < (int)count ? chip8_handlers[order[i]].name : "nop",
+            (unsigned long long)executed, percent(executed, total));
+  }
+
+  int top[PROFILE_TOP];
+  found = top_counters(profile->pc, MEM_SIZE, top);
+  fprintf(out, "\nhottest instructions\n");
+  for (int i = 0; i < found && i < PROFILE_TOP; i++) {
+    int pc = top[i];
+    uint16_t opcode = profile->last_opcode[pc];
+    CHIP8_INST inst;
+    chip8_decode(opcode, 0, &inst);
+    fprintf(out, "  %03X %04X %-4s %12llu %6.2f%%\n", pc, opcode,
+            chip8_handler_name(inst.func), (unsigned long long)profile->pc[pc],
+            percent(profile->pc[pc], total));
+  }
+
+  heat_map(profile->pc, "instruction heat map", out);
+  heat_map(profile->reads, "data read heat map", out);
+  top_addresses(profile->reads, "most read addresses", out);
+  heat_map(profile->writes, "data write heat map", out);
+  top_addresses(profile->writes, "most written addresses", out);
+}
+
+#endif  // CHIP8_PROFILE
@@ -0,0 +1,83 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "chip8.h"
+
+/**
+ * Execution profiler, built in with -DCHIP8_PROFILE and switched on at run time
+ * by pointing the CHIP8_PROFILE_REPORT environment variable at a report file.
+ * The report is written at exit and whenever the process gets SIGUSR1, by the
+ * next instruction or timer tick of any instance.
+ *
+ * Only the interpreter is hooked, instructions run inside JIT blocks are not
+ * counted. Counters are shared by every instance in the process and updated
+ * atomically, so threads running instances at once all count.
+ */
+#ifdef CHIP8_PROFILE
+
+#include <stdatomic.h>
+
+typedef _Atomic uint64_t PROFILE_COUNTER;
+
+typedef struct profile {
+  PROFILE_COUNTER instructions;
+  PROFILE_COUNTER opcodes[0x10000];  // executions of every opcode
+  PROFILE_COUNTER pc[MEM_SIZE];      // executions at every address
+  // opcode last executed at every address
+  _Atomic uint16_t last_opcode[MEM_SIZE];
+  PROFILE_COUNTER reads[MEM_SIZE];   // data reads: sprites, FX65
+  PROFILE_COUNTER writes[MEM_SIZE];  // data writes: FX33, FX55
+  const char *file_name;
+} PROFILE;
+
+// active profile, NULL while profiling is off
+extern PROFILE *chip8_profile;
+
+void profile_init();
+
+void profile_exec(CHIP8 *chip8, uint16_t pc, const CHIP8_INST *inst);
+
+void profile_mem(PROFILE_COUNTER *heat, uint16_t addr, uint16_t len);
+
+void profile_frame();
+
+void profile_report(PROFILE *profile, FILE *out);
+
+// count an instruction after it ran, its decoded entry is up to date by then
+#define PROFILE_EXEC(chip8, pc, inst)      \
+  do {                                     \
+    if (chip8_profile) {                   \
+      profile_exec((chip8), (pc), (inst)); \
+    }                                      \
+  } while (0)
+// a timer tick, writes a report asked for while no instruction runs
+#define PROFILE_FRAME()   \
+  do {                    \
+    if (chip8_profile) {  \
+      profile_frame();    \
+    }                     \
+  } while (0)
+#define PROFILE_READ(addr, len)                         \
+  do {                                                  \
+    if (chip8_profile) {                                \
+      profile_mem(chip8_profile->reads, (addr), (len)); \
+    }                                                   \
+  } while (0)
+#define PROFILE_WRITE(addr, len)                         \
+  do {                                                   \
+    if (chip8_profile) {                                 \
+      profile_mem(chip8_profile->writes, (addr), (len)); \
+    }                                                    \
+  } while (0)
+
+#else
+
+#define profile_init() ((void)0)
+#define PROFILE_EXEC(chip8, pc, inst) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_READ(addr, len) ((void)0)
+#define PROFILE_WRITE(addr, len) ((void)0)
+
+#endif  // CHIP8_PROFILE
+
+#endif  //__PROFILE_H__
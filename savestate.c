@@ -0,0 +1,152 @@
+#include "savestate.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The machine state is saved as the bytes of CHIP8 up to CHIP8_STATE_SIZE, so
+// every field of it is pinned where the files written by this
+// SAVESTATE_VERSION have it. A build that moves one fails here: bump the
+// version along with these offsets.
+#define SAVED_AT(field, offset)                      \
+  _Static_assert(offsetof(CHIP8, field) == (offset), \
+                 "savestate layout changed: " #field)
+// right after the framebuffer
+#define STATE_KEYS (64 + DISPLAY_BYTES)
+
+SAVED_AT(reg, 0);
+SAVED_AT(index_reg, 16);
+SAVED_AT(pc, 18);
+SAVED_AT(opcode, 20);
+SAVED_AT(sp, 22);
+SAVED_AT(delay_timer, 23);
+SAVED_AT(sound_timer, 24);
+SAVED_AT(vip_clock, 26);
+SAVED_AT(rng, 28);
+SAVED_AT(stack, 32);
+SAVED_AT(display, 64);
+SAVED_AT(keys, STATE_KEYS);
+#if CHIP8_VARIANT == CHIP8_CLASSIC
+SAVED_AT(display_refresh_flag, STATE_KEYS + 16);
+#else
+SAVED_AT(hires, STATE_KEYS + 16);
+SAVED_AT(flags, STATE_KEYS + 17);
+#endif
+#if CHIP8_VARIANT == CHIP8_SCHIP
+SAVED_AT(display_refresh_flag, STATE_KEYS + 33);
+#elif CHIP8_VARIANT == CHIP8_XO
+SAVED_AT(planes, STATE_KEYS + 33);
+SAVED_AT(pitch, STATE_KEYS + 34);
+SAVED_AT(pattern, STATE_KEYS + 35);
+SAVED_AT(display_refresh_flag, STATE_KEYS + 51);
+#endif
+
+/**
+ * @brief capture the machine state, memory is gathered page by page
+ * @param  *chip8: instance to capture
+ * @param  *snapshot: destination
+ * @retval None
+ */
+void chip8_snapshot(CHIP8 *chip8, CHIP8_SNAPSHOT *snapshot) {
+  snapshot->magic = SAVESTATE_MAGIC;
+  snapshot->version = SAVESTATE_VERSION;
+  snapshot->size = CHIP8_STATE_SIZE;
+  snapshot->reserved = 0;
+  for (int page = 0; page < MEM_PAGES; page++) {
+    memcpy(snapshot->mem + page * MEM_PAGE_SIZE, chip8->pages[page],
+           MEM_PAGE_SIZE);
+  }
+  memcpy(snapshot->state, chip8, CHIP8_STATE_SIZE);
+}
+
+/**
+ * @brief put an instance back in a captured state
+ * @note only the pages of mem that differ are written and drop their
+ * predecoded instructions, pages that are back to the image's content are
+ * shared with it again; a JIT attached to the instance must be flushed by the
+ * caller
+ * @param  *chip8: instance to restore
+ * @param  *snapshot: state from chip8_snapshot or chip8_load_state
+ * @retval 1 on success, 0 if the snapshot comes from another layout
+ */
+uint8_t chip8_restore(CHIP8 *chip8, const CHIP8_SNAPSHOT *snapshot) {
+  if (snapshot->magic != SAVESTATE_MAGIC ||
+      snapshot->version != SAVESTATE_VERSION ||
+      snapshot->size != CHIP8_STATE_SIZE) {
+    return 0;
+  }
+  for (int page = 0; page < MEM_PAGES; page++) {
+    const uint8_t *mem = snapshot->mem + page * MEM_PAGE_SIZE;
+    if (!memcmp(chip8->pages[page], mem, MEM_PAGE_SIZE)) {
+      continue;
+    }
+    if (memcmp(chip8->image->pages[page], mem, MEM_PAGE_SIZE)) {
+      chip8_write(chip8, page * MEM_PAGE_SIZE, mem, MEM_PAGE_SIZE);
+      continue;
+    }
+    // back to what the image holds
+    chip8_share_page(chip8, page);
+  }
+  memcpy(chip8, snapshot->state, CHIP8_STATE_SIZE);
+  return 1;
+}
+
+/**
+ * @brief write a savestate file
+ * @param  *chip8: instance to save
+ * @param  *file_name: destination path, replaced if it exists
+ * @retval 1 on success
+ */
+uint8_t chip8_save_state(CHIP8 *chip8, const char *file_name) {
+  int fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("open savestate error\n");
+    return 0;
+  }
+  if (ftruncate(fd, sizeof(CHIP8_SNAPSHOT))) {
+    close(fd);
+    return 0;
+  }
+  CHIP8_SNAPSHOT *snapshot = mmap(NULL, sizeof(CHIP8_SNAPSHOT),
+                                  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (snapshot == MAP_FAILED) {
+    return 0;
+  }
+  chip8_snapshot(chip8, snapshot);
+  munmap(snapshot, sizeof(CHIP8_SNAPSHOT));
+  return 1;
+}
+
+/**
+ * @brief restore an instance from a savestate file, straight from the mapping
+ * @param  *chip8: instance to restore
+ * @param  *file_name: file written by chip8_save_state
+ * @retval 1 on success
+ */
+uint8_t chip8_load_state(CHIP8 *chip8, const char *file_name) {
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    printf("open savestate error\n");
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size != sizeof(CHIP8_SNAPSHOT)) {
+    printf("savestate size mismatch\n");
+    close(fd);
+    return 0;
+  }
+  const CHIP8_SNAPSHOT *snapshot =
+      mmap(NULL, sizeof(CHIP8_SNAPSHOT), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (snapshot == MAP_FAILED) {
+    return 0;
+  }
+  uint8_t ok = chip8_restore(chip8, snapshot);
+  if (!ok) {
+    printf("savestate version mismatch\n");
+  }
+  munmap((void *)snapshot, sizeof(CHIP8_SNAPSHOT));
+  return ok;
+}
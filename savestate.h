@@ -0,0 +1,30 @@
+#ifndef __SAVESTATE_H__
+#define __SAVESTATE_H__
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define SAVESTATE_MAGIC 0x53533843  // "C8SS"
+// bump whenever the layout of the machine state in CHIP8 changes
+#define SAVESTATE_VERSION 3
+
+typedef struct chip8_snapshot {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;  // CHIP8_STATE_SIZE of the build that wrote it
+  uint32_t reserved;  // keeps the state 16-byte aligned
+  uint8_t mem[MEM_SIZE];
+  // reg, index_reg, pc, sp, timers, vip_clock, rng, stack, display, keys
+  uint8_t state[CHIP8_STATE_SIZE];
+} CHIP8_SNAPSHOT;
+
+void chip8_snapshot(CHIP8 *chip8, CHIP8_SNAPSHOT *snapshot);
+
+uint8_t chip8_restore(CHIP8 *chip8, const CHIP8_SNAPSHOT *snapshot);
+
+uint8_t chip8_save_state(CHIP8 *chip8, const char *file_name);
+
+uint8_t chip8_load_state(CHIP8 *chip8, const char *file_name);
+
+#endif  //__SAVESTATE_H__
@@ -0,0 +1,478 @@
+#include "stream.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+// macOS, SO_NOSIGPIPE is set on every socket instead
+#define MSG_NOSIGNAL 0
+#endif
+
+#define STREAM_HELLO_SIZE 12
+#define STREAM_HEADER_SIZE 9
+// longest payload: a triple per literal in the worst case
+#define STREAM_PAYLOAD_MAX (2 * DISPLAY_BYTES + 2)
+#define STREAM_MESSAGE_MAX (STREAM_HEADER_SIZE + STREAM_PAYLOAD_MAX)
+
+#define FRAME_INDEX 3
+#define FRAME_FRESH 4
+
+typedef struct stream_frame {
+  DISPLAY_ROW display[DISPLAY_PLANES * DISPLAY_HEIGHT];
+  uint16_t keys;
+  uint32_t number;
+} STREAM_FRAME;
+
+typedef struct stream_viewer {
+  int fd;
+  uint16_t keys;          // keys this viewer holds down
+  uint8_t keyframe;       // next message must be a keyframe
+  uint32_t pending;       // bytes of `out` still to send, the viewer is
+                          // behind while there are any
+  uint32_t sent;          // bytes of `out` already sent
+  uint8_t out[STREAM_HELLO_SIZE + STREAM_MESSAGE_MAX];
+} STREAM_VIEWER;
+
+struct stream {
+  int listener;
+  int wake[2];  // pipe, a byte in it wakes the server thread
+  char *path;   // Unix socket to remove on close, NULL for TCP
+  atomic_bool closing;
+  _Atomic uint16_t keys;  // keys held by any viewer
+
+  // lock-free triple buffer from stream_frame() to the server thread, the
+  // same handoff as the emulator's render thread
+  STREAM_FRAME frames[3];
+  int back;           // emulation thread only
+  int front;          // server thread only
+  atomic_int middle;  // index of the middle frame, FRAME_FRESH until taken
+  uint32_t number;    // frames passed to stream_frame()
+
+  // server thread only
+  STREAM_VIEWER *viewers[STREAM_VIEWERS_MAX];
+  int viewer_count;
+  uint8_t last[DISPLAY_BYTES];  // frame the viewers are up to date with
+  uint16_t last_keys;
+  uint32_t last_number;
+  pthread_t thread;
+};
+
+/**
+ * Run-length encode `old` XOR `new`: (skip, count, literals) triples, a
+ * literal run only ends at two unchanged bytes in a row. Trailing unchanged
+ * bytes are left out.
+ * @retval payload size, 0 when nothing changed
+ */
+static size_t encode(const uint8_t *old, const uint8_t *new, uint8_t *out) {
+  size_t size = 0;
+  size_t i = 0;
+  while (i < DISPLAY_BYTES) {
+    size_t skip = 0;
+    while (i < DISPLAY_BYTES && old[i] == new[i] && skip < 255) {
+      skip++;
+      i++;
+    }
+    if (i == DISPLAY_BYTES) {
+      break;
+    }
+    size_t count = 0;
+    while (i + count < DISPLAY_BYTES && count < 255 &&
+           (old[i + count] != new[i + count] ||
+            (i + count + 1 < DISPLAY_BYTES &&
+             old[i + count + 1] != new[i + count + 1]))) {
+      count++;
+    }
+    out[size++] = skip;
+    out[size++] = count;
+    for (size_t j = 0; j < count; j++) {
+      out[size++] = old[i + j] ^ new[i + j];
+    }
+    i += count;
+  }
+  return size;
+}
+
+static void put16(uint8_t *p, uint16_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t value) {
+  put16(p, value);
+  put16(p + 2, value >> 16);
+}
+
+/**
+ * Header and payload of a message about the last frame, against `old`
+ * @retval message size
+ */
+static size_t build_message(STREAM *stream, const uint8_t *old, uint8_t flags,
+                            uint8_t *out) {
+  size_t size = encode(old, stream->last, out + STREAM_HEADER_SIZE);
+  put16(out, size);
+  out[2] = flags;
+  put16(out + 3, stream->last_keys);
+  put32(out + 5, stream->last_number);
+  return STREAM_HEADER_SIZE + size;
+}
+
+/**
+ * Send what the viewer has queued, as much as the socket takes
+ * @retval 0 when the connection is gone
+ */
+static int flush_viewer(STREAM_VIEWER *viewer) {
+  while (viewer->pending) {
+    ssize_t n = send(viewer->fd, viewer->out + viewer->sent, viewer->pending,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    viewer->sent += n;
+    viewer->pending -= n;
+  }
+  viewer->sent = 0;
+  return 1;
+}
+
+/**
+ * Queue a message for a viewer that has nothing pending and start sending it
+ */
+static int send_viewer(STREAM_VIEWER *viewer, const uint8_t *message,
+                       size_t size) {
+  memcpy(viewer->out + viewer->pending, message, size);
+  viewer->pending += size;
+  return flush_viewer(viewer);
+}
+
+static void update_keys(STREAM *stream) {
+  uint16_t keys = 0;
+  for (int i = 0; i < stream->viewer_count; i++) {
+    keys |= stream->viewers[i]->keys;
+  }
+  atomic_store(&stream->keys, keys);
+}
+
+static void drop_viewer(STREAM *stream, int i) {
+  close(stream->viewers[i]->fd);
+  free(stream->viewers[i]);
+  stream->viewers[i] = stream->viewers[--stream->viewer_count];
+  update_keys(stream);
+}
+
+static void accept_viewer(STREAM *stream) {
+  int fd = accept(stream->listener, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  STREAM_VIEWER *viewer = NULL;
+  if (stream->viewer_count < STREAM_VIEWERS_MAX) {
+    viewer = calloc(1, sizeof(STREAM_VIEWER));
+  }
+  if (!viewer) {
+    close(fd);
+    return;
+  }
+  int on = 1;
+  if (!stream->path) {
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+#ifdef SO_NOSIGPIPE
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  viewer->fd = fd;
+  viewer->keyframe = 1;
+  uint8_t hello[STREAM_HELLO_SIZE] = {0};
+  put32(hello, STREAM_MAGIC);
+  hello[4] = STREAM_VERSION;
+  hello[5] = DISPLAY_PLANES;
+  put16(hello + 6, DISPLAY_WIDTH);
+  put16(hello + 8, DISPLAY_HEIGHT);
+  stream->viewers[stream->viewer_count++] = viewer;
+  if (!send_viewer(viewer, hello, sizeof(hello))) {
+    drop_viewer(stream, stream->viewer_count - 1);
+  }
+}
+
+/**
+ * Key events from a viewer
+ * @retval 0 when the connection is gone
+ */
+static int read_keys(STREAM *stream, STREAM_VIEWER *viewer) {
+  uint8_t events[64];
+  ssize_t n = recv(viewer->fd, events, sizeof(events), MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                 errno != EINTR)) {
+    return 0;
+  }
+  for (ssize_t i = 0; i < n; i++) {
+    uint16_t bit = 1 << (events[i] & 0xF);
+    if (events[i] & 0x80) {
+      viewer->keys |= bit;
+    } else {
+      viewer->keys &= ~bit;
+    }
+  }
+  if (n > 0) {
+    update_keys(stream);
+  }
+  return 1;
+}
+
+/**
+ * Take the newest frame from the triple buffer, encode its delta once and
+ * hand it to every viewer that is keeping up. A viewer still sending an
+ * older message misses this one and gets a keyframe once it has caught up.
+ */
+static void broadcast(STREAM *stream) {
+  if (!(atomic_load(&stream->middle) & FRAME_FRESH)) {
+    return;
+  }
+  stream->front = atomic_exchange(&stream->middle, stream->front) &
+                  FRAME_INDEX;
+  const STREAM_FRAME *frame = &stream->frames[stream->front];
+  uint8_t old[DISPLAY_BYTES];
+  memcpy(old, stream->last, sizeof(old));
+  chip8_display_bytes(frame->display, stream->last);
+  stream->last_number = frame->number;
+  if (!memcmp(old, stream->last, sizeof(old)) &&
+      frame->keys == stream->last_keys) {
+    return;
+  }
+  stream->last_keys = frame->keys;
+  uint8_t message[STREAM_MESSAGE_MAX];
+  size_t size = build_message(stream, old, 0, message);
+  for (int i = stream->viewer_count - 1; i >= 0; i--) {
+    STREAM_VIEWER *viewer = stream->viewers[i];
+    if (viewer->keyframe || viewer->pending) {
+      viewer->keyframe = 1;
+    } else if (!send_viewer(viewer, message, size)) {
+      drop_viewer(stream, i);
+    }
+  }
+}
+
+/**
+ * Bring the viewers that are due a keyframe and have caught up in sync
+ */
+static void send_keyframes(STREAM *stream) {
+  static const uint8_t blank[DISPLAY_BYTES];
+  uint8_t message[STREAM_MESSAGE_MAX];
+  size_t size = 0;
+  for (int i = stream->viewer_count - 1; i >= 0; i--) {
+    STREAM_VIEWER *viewer = stream->viewers[i];
+    if (!viewer->keyframe || viewer->pending) {
+      continue;
+    }
+    if (!size) {
+      size = build_message(stream, blank, STREAM_KEYFRAME, message);
+    }
+    viewer->keyframe = 0;
+    if (!send_viewer(viewer, message, size)) {
+      drop_viewer(stream, i);
+    }
+  }
+}
+
+static void *serve(void *arg) {
+  STREAM *stream = arg;
+  struct pollfd *fds = malloc((STREAM_VIEWERS_MAX + 2) * sizeof(*fds));
+  if (!fds) {
+    return NULL;
+  }
+  while (!atomic_load(&stream->closing)) {
+    fds[0] = (struct pollfd){stream->wake[0], POLLIN, 0};
+    fds[1] = (struct pollfd){stream->listener, POLLIN, 0};
+    int count = stream->viewer_count;
+    for (int i = 0; i < count; i++) {
+      short events = POLLIN | (stream->viewers[i]->pending ? POLLOUT : 0);
+      fds[i + 2] = (struct pollfd){stream->viewers[i]->fd, events, 0};
+    }
+    if (poll(fds, count + 2, -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      uint8_t drain[64];
+      while (read(stream->wake[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    // viewers move around when one is dropped, go from the end
+    for (int i = count - 1; i >= 0; i--) {
+      STREAM_VIEWER *viewer = stream->viewers[i];
+      short revents = fds[i + 2].revents;
+      if (((revents & (POLLIN | POLLHUP | POLLERR)) &&
+           !read_keys(stream, viewer)) ||
+          ((revents & POLLOUT) && !flush_viewer(viewer))) {
+        drop_viewer(stream, i);
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      accept_viewer(stream);
+    }
+    broadcast(stream);
+    send_keyframes(stream);
+  }
+  free(fds);
+  return NULL;
+}
+
+/**
+ * Listening socket for `address`: a port number on 127.0.0.1, or a Unix
+ * socket path when it has a slash in it
+ */
+static int listen_on(STREAM *stream, const char *address) {
+  int fd;
+  if (strchr(address, '/')) {
+    struct sockaddr_un addr = {0};
+    if (strlen(address) >= sizeof(addr.sun_path) ||
+        !(stream->path = strdup(address))) {
+      return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, address);
+    unlink(address);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  } else {
+    char *end;
+    unsigned long port = strtoul(address, &end, 10);
+    if (*end || port == 0 || port > 65535) {
+      return -1;
+    }
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    if (fd >= 0) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0 && listen(fd, 64) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  if (fd >= 0) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+  return fd;
+}
+
+/**
+ * @brief start serving viewers
+ * @param  *address: port number to listen on at 127.0.0.1, or a Unix socket
+ * path (anything with a slash)
+ * @retval the stream, NULL when the address can't be listened on
+ */
+STREAM *stream_open(const char *address) {
+  STREAM *stream = calloc(1, sizeof(STREAM));
+  if (!stream) {
+    return NULL;
+  }
+  stream->back = 0;
+  stream->front = 1;
+  stream->middle = 2;
+  stream->wake[0] = stream->wake[1] = -1;
+  stream->listener = listen_on(stream, address);
+  if (stream->listener < 0 || pipe(stream->wake) < 0) {
+    fprintf(stderr, "stream listen error: %s\n", address);
+    if (stream->listener >= 0) {
+      close(stream->listener);
+    }
+    free(stream->path);
+    free(stream);
+    return NULL;
+  }
+  fcntl(stream->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(stream->wake[1], F_SETFL, O_NONBLOCK);
+  if (pthread_create(&stream->thread, NULL, serve, stream) != 0) {
+    stream->thread = 0;
+    stream_close(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+/**
+ * @brief hand the current frame to the server thread, called once per 60 Hz
+ * frame
+ * @note never waits: the frame replaces one the server hasn't taken yet
+ * @param  *stream: stream, may be NULL
+ * @param  *chip8: instance whose framebuffer and keys are streamed
+ * @retval None
+ */
+void stream_frame(STREAM *stream, const CHIP8 *chip8) {
+  if (!stream) {
+    return;
+  }
+  STREAM_FRAME *frame = &stream->frames[stream->back];
+  memcpy(frame->display, chip8->display, sizeof(frame->display));
+  frame->keys = chip8_key_mask((CHIP8 *)chip8);
+  frame->number = stream->number++;
+  int old = atomic_exchange(&stream->middle, stream->back | FRAME_FRESH);
+  stream->back = old & FRAME_INDEX;
+  // a fresh frame left untaken still has its wakeup queued
+  if (!(old & FRAME_FRESH)) {
+    uint8_t byte = 0;
+    if (write(stream->wake[1], &byte, 1) < 0) {
+      // pipe full, the server thread is awake anyway
+    }
+  }
+}
+
+/**
+ * @brief keys held down by the viewers
+ * @param  *stream: stream, may be NULL
+ * @retval bit i for key i
+ */
+uint16_t stream_keys(STREAM *stream) {
+  return stream ? atomic_load(&stream->keys) : 0;
+}
+
+/**
+ * @brief disconnect every viewer and stop listening
+ * @param  *stream: stream, may be NULL
+ * @retval None
+ */
+void stream_close(STREAM *stream) {
+  if (!stream) {
+    return;
+  }
+  if (stream->thread) {
+    atomic_store(&stream->closing, 1);
+    uint8_t byte = 0;
+    if (write(stream->wake[1], &byte, 1) < 0) {
+      // pipe full, the server thread is awake anyway
+    }
+    pthread_join(stream->thread, NULL);
+  }
+  for (int i = 0; i < stream->viewer_count; i++) {
+    close(stream->viewers[i]->fd);
+    free(stream->viewers[i]);
+  }
+  close(stream->listener);
+  close(stream->wake[0]);
+  close(stream->wake[1]);
+  if (stream->path) {
+    unlink(stream->path);
+    free(stream->path);
+  }
+  free(stream);
+}
@@ -0,0 +1,47 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define STREAM_MAGIC 0x54533843  // "C8ST"
+#define STREAM_VERSION 1
+// viewers served at once, further connections are closed right away
+#define STREAM_VIEWERS_MAX 1024
+// the message is against an all-black screen, not the previous frame
+#define STREAM_KEYFRAME 0x01
+
+/**
+ * Frame streaming server: viewers connect to a localhost TCP port or a Unix
+ * socket, watch the framebuffer and press keys. stream_frame() only copies
+ * the frame for the server thread, which encodes it once for every viewer
+ * and does all the socket work.
+ *
+ * Numbers are little endian. A viewer first gets a 12-byte hello: the magic,
+ * STREAM_VERSION, DISPLAY_PLANES (1 byte each), the display width and height
+ * (2 bytes each) and 2 zero bytes. Then one message per frame that changed
+ * the display or the keys, frames that change neither are not sent:
+ *   payload size (2 bytes), flags (1 byte, STREAM_KEYFRAME), keys held in the
+ *   core (2 bytes, bit i for key i), frame number (4 bytes), payload
+ * The framebuffer is DISPLAY_BYTES packed by chip8_display_bytes(): rows top
+ * to bottom, 8 pixels per byte with the leftmost in the top bit, one plane
+ * after the other. The payload is its XOR with the previous frame,
+ * run-length encoded as (zero bytes to skip, literal count, literals)
+ * triples of 1 + 1 + count bytes; bytes past the last triple are unchanged. A viewer's first message,
+ * and the first after it fell behind and missed some, is a keyframe.
+ *
+ * Viewers send one byte per key event: the key number, plus 0x80 for a press.
+ * The core sees the keys held by any viewer.
+ */
+typedef struct stream STREAM;
+
+STREAM *stream_open(const char *address);
+
+void stream_frame(STREAM *stream, const CHIP8 *chip8);
+
+uint16_t stream_keys(STREAM *stream);
+
+void stream_close(STREAM *stream);
+
+#endif  //__STREAM_H__
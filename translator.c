@@ -0,0 +1,271 @@
+/**
+ * Ahead-of-time ROM to C translator, see aot.h.
+ *
+ * Control flow is traced from MEM_START: 1NNN and 2NNN targets, return points
+ * after calls, both sides of skips and FX0A start basic blocks. BNNN and
+ * 00EE end a block without known successors, their targets are found at run
+ * time by the interpreter or, for return points, by the block dispatch.
+ * Handlers are picked for one set of quirks, the translation only attaches to
+ * instances running with the same.
+ */
+#include <unistd.h>
+
+#include "chip8.h"
+
+// instructions per block, bounds how much of a burst the interpreter runs
+#define BLOCK_MAX 64
+
+typedef struct translation {
+  uint8_t mem[MEM_SIZE];
+  uint32_t size;              // ROM size
+  uint32_t quirks;
+  uint8_t reached[MEM_SIZE];  // an instruction starts here
+  uint8_t leader[MEM_SIZE];   // a basic block starts here
+  uint8_t code[MEM_SIZE / 8];
+  uint16_t work[MEM_SIZE];
+  int work_count;
+} TRANSLATION;
+
+static uint16_t fetch_word(TRANSLATION *t, uint32_t addr) {
+  return t->mem[addr & (MEM_SIZE - 1)] << 8 |
+         t->mem[(addr + 1) & (MEM_SIZE - 1)];
+}
+
+/**
+ * Whole instruction inside the ROM image, anything else is left to the
+ * interpreter
+ */
+static uint8_t in_rom(TRANSLATION *t, uint32_t addr, int bytes) {
+  return addr >= MEM_START && addr + bytes <= MEM_START + t->size;
+}
+
+static int inst_bytes(uint16_t opcode) {
+#if CHIP8_VARIANT == CHIP8_XO
+  // F000 NNNN carries its address in the next word
+  if (opcode == 0xF000) {
+    return 4;
+  }
+#endif
+  return 2;
+}
+
+static void reach(TRANSLATION *t, uint32_t addr, uint8_t leader) {
+  if (!in_rom(t, addr, inst_bytes(fetch_word(t, addr)))) {
+    return;
+  }
+  t->leader[addr] |= leader;
+  if (!t->reached[addr]) {
+    t->reached[addr] = 1;
+    t->work[t->work_count++] = addr;
+  }
+}
+
+static uint8_t is_skip(uint16_t opcode) {
+  switch (opcode >> 12) {
+    case 0x3:
+    case 0x4:
+      return 1;
+    case 0x5:
+    case 0x9:
+      return N(opcode) == 0;
+    case 0xE:
+      return NN(opcode) == 0x9E || NN(opcode) == 0xA1;
+  }
+  return 0;
+}
+
+/**
+ * The instruction may leave pc anywhere but the next instruction, so it ends
+ * its block
+ */
+static uint8_t ends_block(uint16_t opcode) {
+  return opcode == 0x00EE || (opcode >> 12) == 0x1 || (opcode >> 12) == 0x2 ||
+         (opcode >> 12) == 0xB || is_skip(opcode) ||
+         (opcode & 0xF0FF) == 0xF00A;
+}
+
+/**
+ * Writes memory, so it may change translated code
+ */
+static uint8_t writes_mem(uint16_t opcode) {
+#if CHIP8_VARIANT == CHIP8_XO
+  if ((opcode & 0xF00F) == 0x5002) {
+    return 1;
+  }
+#endif
+  return (opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055;
+}
+
+static void trace(TRANSLATION *t) {
+  reach(t, MEM_START, 1);
+  while (t->work_count) {
+    uint16_t addr = t->work[--t->work_count];
+    uint16_t opcode = fetch_word(t, addr);
+    uint32_t next = addr + inst_bytes(opcode);
+    for (uint32_t i = addr; i < next; i++) {
+      t->code[i >> 3] |= 1 << (i & 7);
+    }
+    if ((opcode >> 12) == 0x1) {
+      reach(t, NNN(opcode), 1);
+    } else if ((opcode >> 12) == 0x2) {
+      reach(t, NNN(opcode), 1);
+      reach(t, next, 1);
+    } else if (is_skip(opcode)) {
+      reach(t, next, 1);
+      reach(t, next + inst_bytes(fetch_word(t, next)), 1);
+    } else if ((opcode & 0xF0FF) == 0xF00A) {
+      // waits by running itself again
+      reach(t, addr, 1);
+      reach(t, next, 1);
+    } else if (opcode != 0x00EE && (opcode >> 12) != 0xB) {
+      reach(t, next, 0);
+    }
+  }
+}
+
+static void write_data(TRANSLATION *t, const char *rom_name, FILE *out) {
+  fprintf(out, "const char aot_rom_name[] = \"");
+  for (const char *c = rom_name; *c; c++) {
+    fprintf(out, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+  }
+  fprintf(out, "\";\n\nconst uint32_t aot_rom_size = %u;\n", t->size);
+  fprintf(out, "\nconst uint32_t aot_quirks = 0x%02X;\n", t->quirks);
+  fprintf(out, "\nconst uint8_t aot_rom[] = {");
+  for (uint32_t i = 0; i < t->size; i++) {
+    fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n    ", t->mem[MEM_START + i]);
+  }
+  fprintf(out, "\n};\n\nconst uint8_t aot_code[MEM_SIZE / 8] = {");
+  for (int i = 0; i < MEM_SIZE / 8; i++) {
+    fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n    ", t->code[i]);
+  }
+  fprintf(out, "\n};\n");
+}
+
+/**
+ * Decoded operands of every translated instruction, constant so the compiler
+ * can fold them into the inlined handlers
+ */
+static void write_operands(TRANSLATION *t, FILE *out) {
+  fprintf(out, "\n");
+  for (uint32_t addr = 0; addr < MEM_SIZE; addr++) {
+    if (!t->reached[addr]) {
+      continue;
+    }
+    CHIP8_INST inst;
+    chip8_decode(fetch_word(t, addr), t->quirks, &inst);
+    const char *name = chip8_handler_name(inst.func);
+    if (strcmp(name, "nop") == 0) {
+      continue;
+    }
+    fprintf(out,
+            "static const CHIP8_INST op_%04X = {opcode_%s, 0x%04X, 0x%03X, %u, "
+            "%u, %u, 0x%02X};\n",
+            addr, name, inst.opcode, inst.nnn, inst.x, inst.y, inst.n,
+            inst.nn);
+  }
+}
+
+static void write_block(TRANSLATION *t, uint16_t start, FILE *out) {
+  // count the instructions first, the budget check comes before them
+  int count = 0;
+  uint32_t addr = start;
+  uint16_t opcode;
+  do {
+    opcode = fetch_word(t, addr);
+    addr += inst_bytes(opcode);
+    count++;
+  } while (!ends_block(opcode) && count < BLOCK_MAX &&
+           in_rom(t, addr, 2) && t->reached[addr] && !t->leader[addr]);
+
+  fprintf(out, "    case 0x%03X:\n", start);
+  fprintf(out, "      if (cycles - done < %d) {\n        return done;\n      }\n",
+          count);
+  addr = start;
+  for (int i = 1; i <= count; i++) {
+    opcode = fetch_word(t, addr);
+    uint32_t next = addr + 2;
+    CHIP8_INST inst;
+    chip8_decode(opcode, t->quirks, &inst);
+    const char *name = chip8_handler_name(inst.func);
+    if (strcmp(name, "nop") == 0) {
+      fprintf(out, "      // %04X\n", opcode);
+    } else {
+      // handlers that read or move pc expect it past the opcode
+      if (ends_block(opcode) || opcode == 0xF000) {
+        fprintf(out, "      chip8->pc = 0x%03X;\n", next);
+      }
+      fprintf(out, "      opcode_%s(chip8, &op_%04X);\n", name, addr);
+    }
+    addr += inst_bytes(opcode);
+    if (writes_mem(opcode)) {
+      fprintf(out,
+              "      if (chip8 != aot_machine) {\n"
+              "        chip8->pc = 0x%03X;\n"
+              "        return done + %d;\n"
+              "      }\n",
+              addr, i);
+    }
+  }
+  if (!ends_block(opcode)) {
+    fprintf(out, "      chip8->pc = 0x%03X;\n", addr);
+  }
+  fprintf(out, "      done += %d;\n      break;\n", count);
+}
+
+static int translate(const char *rom_name, const char *output,
+                     uint32_t quirks) {
+  static TRANSLATION t;
+  t.quirks = quirks;
+  FILE *rom = fopen(rom_name, "rb");
+  if (!rom) {
+    fprintf(stderr, "open rom error: %s\n", rom_name);
+    return -1;
+  }
+  t.size = fread(t.mem + MEM_START, 1, MEM_SIZE - MEM_START, rom);
+  fclose(rom);
+  trace(&t);
+
+  FILE *out = fopen(output, "w");
+  if (!out) {
+    fprintf(stderr, "open output error: %s\n", output);
+    return -1;
+  }
+  fprintf(out, "// generated by chip8-aot from %s, do not edit\n", rom_name);
+  fprintf(out, "#include \"aot.h\"\n\n");
+  fprintf(out, "#if CHIP8_VARIANT != %d\n", CHIP8_VARIANT);
+  fprintf(out, "#error translated for another CHIP8_VARIANT\n#endif\n\n");
+  write_data(&t, rom_name, out);
+  write_operands(&t, out);
+
+  fprintf(out, "\nuint32_t aot_blocks(CHIP8 *chip8, uint32_t cycles) {\n");
+  fprintf(out, "  uint32_t done = 0;\n  for (;;) {\n");
+  fprintf(out, "    switch (chip8->pc) {\n");
+  int blocks = 0;
+  for (uint32_t addr = 0; addr < MEM_SIZE; addr++) {
+    if (t.leader[addr]) {
+      write_block(&t, addr, out);
+      blocks++;
+    }
+  }
+  fprintf(out, "    default:\n      return done;\n    }\n  }\n}\n");
+  fclose(out);
+  printf("%s: %d blocks\n", output, blocks);
+  return 0;
+}
+
+int main(int argc, char *const argv[]) {
+  uint32_t quirks = 0;
+  if (argc == 5 && strcmp(argv[1], "-q") == 0) {
+    if (!chip8_parse_quirks(argv[2], &quirks)) {
+      fprintf(stderr, "unknown quirks: %s\n", argv[2]);
+      return -1;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc != 3) {
+    printf("usage: ./chip8-aot [-q quirks] <rom> <output.c>\n");
+    return -1;
+  }
+  return translate(argv[1], argv[2], quirks);
+}